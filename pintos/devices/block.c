@@ -3,7 +3,73 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/io.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
+
+/* Requests to a block device are asynchronous underneath.
+   block_submit() puts a request in its device's queue and
+   returns at once; a thread per queue takes requests from the
+   queue, in the order chosen by the I/O scheduler, and hands
+   them to the driver.  block_read() and block_write() submit a
+   request and wait for it.
+
+   Each device has a queue of its own unless its driver says
+   otherwise: devices that cannot transfer data at the same time,
+   such as the two disks on an IDE channel, share one, so that
+   their requests are scheduled together and the queue's thread
+   is the only one waiting for the hardware.  Devices with
+   different queues transfer data in parallel.
+
+   Before a request is handed to the driver, queued requests in
+   the same direction that continue where it ends are merged
+   with it, up to MERGE_MAX sectors, so that the driver transfers
+   them all with one command.
+
+   A partition has no queue of its own: its requests go to the
+   queue of the device it is part of, so that they are scheduled
+   together with all the others for that device.
+
+   Requests for overlapping sectors may be served in any order.
+   A caller that cares must wait for one before submitting the
+   other.
+
+   Each device, and each partition, keeps statistics on the
+   requests submitted to it: how long they took from submission
+   to completion, whether each continued where the previous one
+   ended, and how many of its requests were queued at once.
+   These are reported at shutdown if "-blkstat" is given. */
+
+/* Most sectors in a merged request. */
+#define MERGE_MAX 32
+
+/* Number of log2 buckets in a latency histogram. */
+#define LATENCY_BUCKETS 40
+
+/* Latency of one direction of requests to a device. */
+struct block_latency
+  {
+    unsigned long long cnt;             /* Number of requests. */
+    uint64_t total_cycles;              /* Sum of latencies. */
+    uint64_t max_cycles;                /* Greatest latency. */
+    unsigned hist[LATENCY_BUCKETS];     /* Counts by log2 of cycles. */
+  };
+
+/* A request queue. */
+struct block_queue
+  {
+    char name[16];                      /* Name, e.g. "ide0". */
+    struct lock lock;                   /* Protects the members below. */
+    struct condition nonempty;          /* Signaled when a request arrives. */
+    struct list requests;               /* Queued struct block_requests. */
+    uint64_t head;                      /* Position after the last served. */
+    uint8_t *merge_buffer;              /* MERGE_MAX sectors. */
+  };
 
 /* A block device. */
 struct block
@@ -17,17 +83,63 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    struct block *parent;               /* Device partitioned, or null. */
+    block_sector_t start;               /* First sector within PARENT. */
+
+    struct block_queue *queue;          /* Request queue, if no PARENT. */
+    unsigned no;                        /* Number in probe order. */
+
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Statistics on requests, updated with the queue's lock held
+       or by the queue's thread. */
+    struct block_latency latency[2];    /* Reads, writes. */
+    unsigned long long seq_cnt;         /* Requests at NEXT_SECTOR. */
+    unsigned long long random_cnt;      /* Requests elsewhere. */
+    block_sector_t next_sector;         /* Sector after last request. */
+    unsigned queued;                    /* Requests in the queue now. */
+    unsigned max_queued;                /* Most requests ever queued. */
+    unsigned long long queued_total;    /* Sum of QUEUED on arrivals. */
+  };
+
+/* An I/O scheduler, which decides the order in which queued
+   requests are served. */
+struct block_scheduler
+  {
+    const char *name;                   /* Name for -iosched option. */
+
+    /* Adds request R to QUEUE. */
+    void (*add) (struct list *queue, struct block_request *r);
+
+    /* Returns the request in nonempty QUEUE to serve next, given
+       that the last one served ended at position HEAD. */
+    struct block_request *(*next) (struct list *queue, uint64_t head);
   };
 
+/* Scheduler in use. */
+static const struct block_scheduler *scheduler;
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* Controlled by kernel command-line option "-blkstat". */
+bool blkstat_enabled;
+
 static struct block *list_elem_to_block (struct list_elem *);
+static struct block *register_block (const char *name, enum block_type,
+                                     const char *extra_info,
+                                     block_sector_t size);
+static uint64_t position (const struct block_request *);
+static thread_func queue_worker;
+static void enqueue (struct block *, struct block_request *);
+static void note_arrival (struct block *, const struct block_request *);
+static void note_completion (struct block *, const struct block_request *,
+                             uint64_t now);
+static void print_block_stats (const struct block *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +232,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +243,120 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses a single transfer if the driver supports it.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, false, sector, cnt, buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses a single transfer if the driver supports it.  Returns
+   after the block device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, true, sector, cnt, (void *) buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Initializes R as a request to transfer the CNT sectors
+   starting at SECTOR between a block device and BUFFER, which
+   must have room for CNT * BLOCK_SECTOR_SIZE bytes: from BUFFER
+   to the device if WRITE is true, the other way otherwise.  When
+   the request is done, DONE is called, if it is non-null, from
+   the device's thread; R may then be reused or freed.  If DONE is
+   null, block_wait() waits for R instead. */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, size_t cnt, void *buffer,
+                    block_done_func *done, void *aux)
+{
+  ASSERT (cnt > 0);
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->done = done;
+  r->aux = aux;
+  sema_init (&r->finished, 0);
+}
+
+/* Queues request R, which must have been initialized with
+   block_request_init(), for BLOCK and returns without waiting
+   for it.  R's SECTOR member is not meaningful afterward. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  r->origin = block;
+  r->submitted = rdtsc ();
+  enqueue (block, r);
+}
+
+/* Checks and counts request R for BLOCK, then adds it to the
+   queue of BLOCK or, if BLOCK is a partition, passes it on to
+   the device partitioned. */
+static void
+enqueue (struct block *block, struct block_request *r)
+{
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+
+  if (block->parent != NULL)
+    {
+      r->sector += block->start;
+      enqueue (block->parent, r);
+      return;
+    }
+
+  r->block = block;
+  lock_acquire (&block->queue->lock);
+  note_arrival (block, r);
+  if (r->origin != block)
+    note_arrival (r->origin, r);
+  scheduler->add (&block->queue->requests, r);
+  cond_signal (&block->queue->nonempty, &block->queue->lock);
+  lock_release (&block->queue->lock);
+}
+
+/* Waits for request R, which must have been submitted without a
+   DONE function, to be done. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->finished);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -164,42 +384,114 @@ block_type (struct block *block)
 void
 block_print_stats (void)
 {
-  // int i;
+  if (blkstat_enabled)
+    {
+      struct block *block;
+
+      for (block = block_first (); block != NULL;
+           block = block_next (block))
+        print_block_stats (block);
+    }
 
-  // for (i = 0; i < BLOCK_CNT; i++)
-  //   {
-  //     struct block *block = block_by_role[i];
-  //     if (block != NULL)
-  //       {
-  //         printf ("%s (%s): %llu reads, %llu writes\n",
-  //                 block->name, block_type_name (block->type),
-  //                 block->read_cnt, block->write_cnt);
-  //       }
-  //   }
+  ide_print_stats ();
+#ifdef FILESYS
+  cache_print_stats ();
+#endif
 }
 
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  Requests to the
+   device go into QUEUE, which may be shared with other devices,
+   or into a new queue if QUEUE is null. */
 struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
-                const struct block_operations *ops, void *aux)
+                const struct block_operations *ops, void *aux,
+                struct block_queue *queue)
+{
+  struct block *block = register_block (name, type, extra_info, size);
+
+  block->ops = ops;
+  block->aux = aux;
+  block->queue = queue != NULL ? queue : block_queue_create (name);
+  return block;
+}
+
+/* Creates and returns a request queue named NAME, and starts the
+   thread that serves it. */
+struct block_queue *
+block_queue_create (const char *name)
+{
+  struct block_queue *queue = malloc (sizeof *queue);
+  char thread_name[sizeof queue->name + 3];
+
+  if (queue == NULL)
+    PANIC ("Failed to allocate memory for block request queue");
+  strlcpy (queue->name, name, sizeof queue->name);
+  lock_init (&queue->lock);
+  cond_init (&queue->nonempty);
+  list_init (&queue->requests);
+  queue->head = 0;
+  queue->merge_buffer = palloc_get_multiple (PAL_ASSERT,
+                                             MERGE_MAX * BLOCK_SECTOR_SIZE
+                                             / PGSIZE);
+
+  /* The thread runs at high priority, so that the devices are
+     kept busy whatever the priorities of the threads waiting for
+     them. */
+  snprintf (thread_name, sizeof thread_name, "%s-io", queue->name);
+  thread_create (thread_name, PRI_MAX, queue_worker, queue, 0);
+  return queue;
+}
+
+/* Returns true if requests to A and B, or to the devices they
+   are partitions of, go into the same queue, so that they are
+   served one after another rather than in parallel. */
+bool
+block_same_queue (struct block *a, struct block *b)
+{
+  while (a->parent != NULL)
+    a = a->parent;
+  while (b->parent != NULL)
+    b = b->parent;
+  return a->queue == b->queue;
+}
+
+/* Registers a new block device with the given NAME, TYPE, and
+   SIZE in sectors, which is a partition of PARENT starting at
+   sector START.  If EXTRA_INFO is non-null, it is printed as part
+   of a user message. */
+struct block *
+block_register_partition (const char *name, enum block_type type,
+                          const char *extra_info, block_sector_t size,
+                          struct block *parent, block_sector_t start)
 {
-  struct block *block = malloc (sizeof *block);
+  struct block *block = register_block (name, type, extra_info, size);
+
+  block->parent = parent;
+  block->start = start;
+  return block;
+}
+
+/* Does the work common to block_register() and
+   block_register_partition(). */
+static struct block *
+register_block (const char *name, enum block_type type,
+                const char *extra_info, block_sector_t size)
+{
+  static unsigned next_no;
+  struct block *block = calloc (1, sizeof *block);
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
   list_push_back (&all_blocks, &block->list_elem);
+  block->no = next_no++;
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
-  block->ops = ops;
-  block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +513,325 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Request queues. */
+
+static size_t merge (struct block_queue *, struct block_request *first,
+                     struct list *batch);
+static void serve (struct block_queue *, struct list *batch, size_t cnt);
+static void transfer (struct block *, bool write, block_sector_t,
+                      size_t cnt, void *buffer);
+
+/* Returns the position of request R's first sector among all
+   the sectors of all the devices that share its queue.  Each
+   device's sectors come after those of devices found before it,
+   so that the scheduler can compare any two requests. */
+static uint64_t
+position (const struct block_request *r) 
+{
+  return ((uint64_t) r->block->no << 32) | r->sector;
+}
+
+/* Thread that serves the requests in QUEUE. */
+static void
+queue_worker (void *queue_) 
+{
+  struct block_queue *queue = queue_;
+
+  for (;;) 
+    {
+      struct block_request *r;
+      struct list batch;
+      struct list_elem *e;
+      size_t cnt;
+
+      lock_acquire (&queue->lock);
+      while (list_empty (&queue->requests))
+        cond_wait (&queue->nonempty, &queue->lock);
+      r = scheduler->next (&queue->requests, queue->head);
+      list_remove (&r->elem);
+      list_init (&batch);
+      list_push_back (&batch, &r->elem);
+      cnt = r->cnt + merge (queue, r, &batch);
+      queue->head = position (r) + cnt;
+      for (e = list_begin (&batch); e != list_end (&batch);
+           e = list_next (e))
+        {
+          struct block_request *b = list_entry (e, struct block_request,
+                                                elem);
+          b->block->queued--;
+          if (b->origin != b->block)
+            b->origin->queued--;
+        }
+      lock_release (&queue->lock);
+
+      serve (queue, &batch, cnt);
+    }
+}
+
+/* Moves the requests in QUEUE that can be merged with FIRST to
+   the end of BATCH, in sector order, and returns the number of
+   sectors they add.  QUEUE's lock must be held. */
+static size_t
+merge (struct block_queue *queue, struct block_request *first,
+       struct list *batch) 
+{
+  block_sector_t end = first->sector + first->cnt;
+  size_t cnt = first->cnt;
+  bool found = true;
+
+  while (found) 
+    {
+      struct list_elem *e;
+
+      found = false;
+      for (e = list_begin (&queue->requests);
+           e != list_end (&queue->requests); e = list_next (e)) 
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                elem);
+          if (r->block == first->block && r->write == first->write
+              && r->sector == end && cnt + r->cnt <= MERGE_MAX) 
+            {
+              list_remove (&r->elem);
+              list_push_back (batch, &r->elem);
+              end += r->cnt;
+              cnt += r->cnt;
+              found = true;
+              break;
+            }
+        }
+    }
+  return cnt - first->cnt;
+}
+
+/* Transfers the CNT sectors of the requests in BATCH, which are
+   adjacent, with a single transfer, and completes them.  QUEUE
+   is the queue they came from. */
+static void
+serve (struct block_queue *queue, struct list *batch, size_t cnt) 
+{
+  struct block_request *first = list_entry (list_front (batch),
+                                            struct block_request, elem);
+  struct block *block = first->block;
+  struct list_elem *e;
+  uint64_t now;
+
+  if (list_front (batch) == list_back (batch))
+    transfer (block, first->write, first->sector, cnt, first->buffer);
+  else 
+    {
+      /* Gather the requests' data into the merge buffer, or
+         scatter it from there. */
+      uint8_t *p;
+
+      if (first->write)
+        for (p = queue->merge_buffer, e = list_begin (batch);
+             e != list_end (batch); e = list_next (e)) 
+          {
+            struct block_request *r = list_entry (e, struct block_request,
+                                                  elem);
+            memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+            p += r->cnt * BLOCK_SECTOR_SIZE;
+          }
+      transfer (block, first->write, first->sector, cnt,
+                queue->merge_buffer);
+      if (!first->write)
+        for (p = queue->merge_buffer, e = list_begin (batch);
+             e != list_end (batch); e = list_next (e)) 
+          {
+            struct block_request *r = list_entry (e, struct block_request,
+                                                  elem);
+            memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+            p += r->cnt * BLOCK_SECTOR_SIZE;
+          }
+    }
+
+  now = rdtsc ();
+  while (!list_empty (batch)) 
+    {
+      struct block_request *r = list_entry (list_pop_front (batch),
+                                            struct block_request, elem);
+      note_completion (block, r, now);
+      if (r->origin != block)
+        note_completion (r->origin, r, now);
+      if (r->done != NULL)
+        r->done (r);
+      else
+        sema_up (&r->finished);
+    }
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   between the device and BUFFER, in the direction given by
+   WRITE. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          size_t cnt, void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++, buffer += BLOCK_SECTOR_SIZE)
+      if (write)
+        block->ops->write (block->aux, sector + i, buffer);
+      else
+        block->ops->read (block->aux, sector + i, buffer);
+}
+
+/* Statistics. */
+
+/* Records in BLOCK's statistics the arrival of request R in its
+   queue.  R's SECTOR is a sector of the device partitioned, if
+   BLOCK is a partition, but so is BLOCK's NEXT_SECTOR. */
+static void
+note_arrival (struct block *block, const struct block_request *r) 
+{
+  if (r->sector == block->next_sector)
+    block->seq_cnt++;
+  else
+    block->random_cnt++;
+  block->next_sector = r->sector + r->cnt;
+
+  block->queued++;
+  if (block->queued > block->max_queued)
+    block->max_queued = block->queued;
+  block->queued_total += block->queued;
+}
+
+/* Records in BLOCK's statistics that request R completed at
+   time NOW, in CPU cycles. */
+static void
+note_completion (struct block *block, const struct block_request *r,
+                 uint64_t now) 
+{
+  struct block_latency *l = &block->latency[r->write];
+  uint64_t cycles = now - r->submitted;
+  int b = 0;
+
+  while ((cycles >> b) > 1 && b < LATENCY_BUCKETS - 1)
+    b++;
+  l->cnt++;
+  l->total_cycles += cycles;
+  if (cycles > l->max_cycles)
+    l->max_cycles = cycles;
+  l->hist[b]++;
+}
+
+/* Prints BLOCK's statistics, if it has served any requests. */
+static void
+print_block_stats (const struct block *block) 
+{
+  static const char *dir_names[] = {"read", "write"};
+  unsigned long long req_cnt = block->seq_cnt + block->random_cnt;
+  int dir, i;
+
+  if (req_cnt == 0)
+    return;
+
+  printf ("%s (%s): %llu bytes read, %llu bytes written\n",
+          block->name, block_type_name (block->type),
+          block->read_cnt * BLOCK_SECTOR_SIZE,
+          block->write_cnt * BLOCK_SECTOR_SIZE);
+  printf ("  %llu requests, %llu sequential, %llu random; "
+          "queue depth avg %llu.%llu, max %u\n",
+          req_cnt, block->seq_cnt, block->random_cnt,
+          block->queued_total / req_cnt,
+          block->queued_total * 10 / req_cnt % 10, block->max_queued);
+  for (dir = 0; dir < 2; dir++)
+    {
+      const struct block_latency *l = &block->latency[dir];
+
+      if (l->cnt == 0)
+        continue;
+      printf ("  %s latency: %llu requests, avg %"PRIu64" cycles "
+              "(max %"PRIu64")\n    cycles:",
+              dir_names[dir], l->cnt, l->total_cycles / l->cnt,
+              l->max_cycles);
+      for (i = 0; i < LATENCY_BUCKETS; i++)
+        if (l->hist[i] != 0)
+          printf (" <2^%d:%u", i + 1, l->hist[i]);
+      printf ("\n");
+    }
+}
+
+/* I/O schedulers. */
+
+/* First in, first out: requests are served in the order they
+   are submitted. */
+static void
+fifo_add (struct list *queue, struct block_request *r) 
+{
+  list_push_back (queue, &r->elem);
+}
+
+static struct block_request *
+fifo_next (struct list *queue, uint64_t head UNUSED) 
+{
+  return list_entry (list_front (queue), struct block_request, elem);
+}
+
+/* Returns true if request A starts before request B. */
+static bool
+request_less (const struct list_elem *a, const struct list_elem *b,
+              void *aux UNUSED) 
+{
+  return (position (list_entry (a, struct block_request, elem))
+          < position (list_entry (b, struct block_request, elem)));
+}
+
+/* C-LOOK elevator: the queue is kept in order of position, and
+   the head sweeps upward through it, serving each request it
+   reaches, then jumps back to the lowest request and sweeps
+   again.  Requests for the same sector are served in the order
+   they were submitted. */
+static void
+clook_add (struct list *queue, struct block_request *r) 
+{
+  list_insert_ordered (queue, &r->elem, request_less, NULL);
+}
+
+static struct block_request *
+clook_next (struct list *queue, uint64_t head) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (queue); e != list_end (queue); e = list_next (e)) 
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (position (r) >= head)
+        return r;
+    }
+  return list_entry (list_front (queue), struct block_request, elem);
+}
+
+/* Available schedulers.  The first is the default. */
+static const struct block_scheduler schedulers[] =
+  {
+    {"clook", clook_add, clook_next},
+    {"fifo", fifo_add, fifo_next},
+    {NULL, NULL, NULL},
+  };
+static const struct block_scheduler *scheduler = &schedulers[0];
+
+/* Makes the I/O scheduler named NAME serve the requests to every
+   block device.  Returns true if successful, false if there is no
+   such scheduler. */
+bool
+block_set_scheduler (const char *name)
+{
+  const struct block_scheduler *s;
+
+  for (s = schedulers; s->name != NULL; s++)
+    if (name != NULL && !strcmp (name, s->name))
+      {
+        scheduler = s;
+        return true;
+      }
+  return false;
+}
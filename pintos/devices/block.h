@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,10 +55,49 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+bool block_same_queue (struct block *, struct block *);
+
+/* Asynchronous requests. */
+
+struct block_request;
+typedef void block_done_func (struct block_request *);
+
+/* A request to transfer CNT sectors starting at SECTOR between a
+   block device and BUFFER.  Owned by the block layer from
+   block_submit() until it is done. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device queue. */
+    struct block *origin;               /* Device submitted to. */
+    struct block *block;                /* Device that serves it. */
+    bool write;                         /* Write (true) or read (false)? */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_done_func *done;              /* Called when done, or null. */
+    void *aux;                          /* For DONE's use. */
+    struct semaphore finished;          /* Up'd when done if DONE is null. */
+    uint64_t submitted;                 /* rdtsc() at submission. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, size_t cnt, void *buffer,
+                         block_done_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+bool block_set_scheduler (const char *name);
 
 /* Statistics. */
+
+/* Controlled by kernel command-line option "-blkstat". */
+extern bool blkstat_enabled;
+
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +106,27 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors at once.  Optional: if
+       null, the sectors are transferred one at a time with
+       READ or WRITE. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
   };
 
+struct block_queue;
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
-                              const struct block_operations *, void *aux);
+                              const struct block_operations *, void *aux,
+                              struct block_queue *);
+struct block *block_register_partition (const char *name, enum block_type,
+                                        const char *extra_info,
+                                        block_sector_t size,
+                                        struct block *parent,
+                                        block_sector_t start);
+struct block_queue *block_queue_create (const char *name);
 
 #endif /* devices/block.h */
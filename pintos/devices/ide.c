@@ -9,9 +9,17 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data is transferred by bus-master DMA when the controller is a
+   PCI IDE controller that supports it, such as the PIIX that
+   QEMU emulates: the CPU only sets up a table describing the
+   buffer and waits for the completion interrupt.  Otherwise, or
+   if the "-pio" option is given, the CPU moves every word
+   through the data register in programmed I/O (PIO) mode. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +42,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -43,12 +52,45 @@
 #define DEV_LBA 0x40            /* Linear based addressing. */
 #define DEV_DEV 0x10            /* Select device: 0=master, 1=slave. */
 
+/* Bus-master IDE port addresses, relative to a channel's
+   bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+
+/* PCI configuration space ports and registers. */
+#define PCI_CONFIG_ADDR 0xcf8           /* Address. */
+#define PCI_CONFIG_DATA 0xcfc           /* Data. */
+#define PCI_REG_ID 0x00                 /* Vendor and device ID. */
+#define PCI_REG_COMMAND 0x04            /* Command. */
+#define PCI_REG_CLASS 0x08              /* Class code and revision. */
+#define PCI_REG_BAR4 0x20               /* Base address 4. */
+#define PCI_CMD_IO 0x0001               /* Enable I/O space. */
+#define PCI_CMD_MASTER 0x0004           /* Enable bus mastering. */
+
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors that one command can transfer.  The Sector Count
+   register holds 0 for this many. */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,22 +99,53 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt (DRQ block). */
+    bool dma;                   /* Transfer data by DMA? */
   };
 
+/* Physical Region Descriptor, describing one physically
+   contiguous part of a DMA buffer.  A region may not cross a
+   64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 for 64 kB. */
+    uint16_t flags;             /* PRD_EOT for the last region. */
+  };
+#define PRD_EOT 0x8000
+
+/* Number of PRDs per channel.  A transfer of MAX_SECTORS_PER_CMD
+   sectors, 128 kB, crosses at most two 64 kB boundaries. */
+#define PRD_CNT 4
+
 /* An ATA channel (aka controller).
-   Each channel can control up to two disks. */
+   Each channel can control up to two disks, but only one of them
+   can transfer data at a time, so both share a block request
+   queue.  The two channels work in parallel, so a disk that is
+   busy at the same time as the file system disk, such as a swap
+   disk, is best put on the other channel. */
 struct channel
   {
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus-master registers, 0 if none. */
 
+    struct block_queue *queue;  /* Request queue for the disks. */
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
+
+    /* Statistics. */
+    uint64_t busy_cycles;           /* Time spent transferring data. */
+    unsigned long long cmd_cnt;     /* Number of data transfers. */
+
+    /* PRD table.  Must not cross a 64 kB boundary. */
+    struct prd prd[PRD_CNT] __attribute__ ((aligned (sizeof (struct prd)
+                                                     * PRD_CNT)));
   };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -81,14 +154,28 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+/* Use PIO even if DMA is available? */
+bool ide_use_pio;
+
+/* Time stamp counter at ide_init(). */
+static uint64_t init_cycles;
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static bool set_multiple_mode (struct ata_disk *, int multiple);
+static uint16_t find_bus_master (void);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
+static void pio_read (struct ata_disk *, block_sector_t, size_t cnt,
+                      void *);
+static void pio_write (struct ata_disk *, block_sector_t, size_t cnt,
+                       const void *);
+static void dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *, bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,8 +188,11 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = ide_use_pio ? 0 : find_bus_master ();
   size_t chan_no;
 
+  init_cycles = rdtsc ();
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -123,6 +213,10 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->queue = NULL;
+      c->busy_cycles = 0;
+      c->cmd_cnt = 0;
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
@@ -136,6 +230,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 1;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +251,27 @@ ide_init (void)
     }
 }
 
+/* Prints, for each channel with disks, the fraction of the time
+   since ide_init() that it spent transferring data. */
+void
+ide_print_stats (void) 
+{
+  uint64_t elapsed = rdtsc () - init_cycles;
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      uint64_t permille;
+
+      if (c->queue == NULL)
+        continue;
+      permille = elapsed > 0 ? c->busy_cycles * 1000 / elapsed : 0;
+      printf ("%s: %llu transfers, %"PRIu64".%"PRIu64"%% busy\n",
+              c->name, c->cmd_cnt, permille / 10, permille % 10);
+    }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -279,7 +396,7 @@ identify_ata_device (struct ata_disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity.
      Read model name and serial number. */
@@ -303,12 +420,93 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Have READ MULTIPLE and WRITE MULTIPLE transfer as many
+     sectors per interrupt as the disk allows. */
+  if ((id[47 * 2] & 0xff) > 1 && set_multiple_mode (d, id[47 * 2] & 0xff))
+    d->multiple = id[47 * 2] & 0xff;
+
+  /* Use DMA if both the disk and the controller support it. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & (1 << 8)) != 0;
+
   /* Register. */
+  if (c->queue == NULL)
+    c->queue = block_queue_create (c->name);
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
-                          &ide_operations, d);
+                          &ide_operations, d, c->queue);
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D, so that READ
+   MULTIPLE and WRITE MULTIPLE transfer MULTIPLE sectors per
+   interrupt.  Returns true if the disk accepts it, false
+   otherwise. */
+static bool
+set_multiple_mode (struct ata_disk *d, int multiple) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  return (inb (reg_alt_status (c)) & STA_ERR) == 0;
+}
+
+/* Reads 32-bit register REG in the PCI configuration space of
+   function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) 
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | reg));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes DATA to 16-bit register REG in the PCI configuration
+   space of function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config16 (int bus, int dev, int func, int reg, uint16_t data) 
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & ~3)));
+  outw (PCI_CONFIG_DATA + (reg & 2), data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus-master
+   DMA.  If there is one, enables bus mastering and returns the
+   base of its bus-master registers.  Returns 0 if there is
+   none. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage controller (0x01), IDE (0x01), with
+           bus-master capability (programming interface bit 7). */
+        class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+        bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, func, PCI_REG_COMMAND);
+        pci_write_config16 (0, dev, func, PCI_REG_COMMAND,
+                            command | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +535,118 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Each command transfers up to MAX_SECTORS_PER_CMD
+   sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  uint64_t start;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  start = rdtsc ();
+  while (cnt > 0) 
+    {
+      size_t sector_cnt = (cnt < MAX_SECTORS_PER_CMD
+                           ? cnt : MAX_SECTORS_PER_CMD);
+
+      c->cmd_cnt++;
+      if (d->dma)
+        dma_transfer (d, sec_no, sector_cnt, buffer, false);
+      else
+        pio_read (d, sec_no, sector_cnt, buffer);
+      buffer += sector_cnt * BLOCK_SECTOR_SIZE;
+      sec_no += sector_cnt;
+      cnt -= sector_cnt;
+    }
+  c->busy_cycles += rdtsc () - start;
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  uint64_t start;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  start = rdtsc ();
+  while (cnt > 0) 
+    {
+      size_t sector_cnt = (cnt < MAX_SECTORS_PER_CMD
+                           ? cnt : MAX_SECTORS_PER_CMD);
+
+      c->cmd_cnt++;
+      if (d->dma)
+        dma_transfer (d, sec_no, sector_cnt, buffer, true);
+      else
+        pio_write (d, sec_no, sector_cnt, buffer);
+      buffer += sector_cnt * BLOCK_SECTOR_SIZE;
+      sec_no += sector_cnt;
+      cnt -= sector_cnt;
+    }
+  c->busy_cycles += rdtsc () - start;
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_SECTORS_PER_CMD, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -401,6 +654,120 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
         DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
 }
 
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER in PIO mode, with one command and one interrupt per
+   D->multiple sectors.  D's channel must be locked. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          void *buffer_)
+{
+  struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple > 1 ? CMD_READ_MULTIPLE
+                         : CMD_READ_SECTOR_RETRY));
+  for (i = 0; i < cnt; i += d->multiple) 
+    {
+      size_t block_cnt = (cnt - i < (size_t) d->multiple
+                          ? cnt - i : (size_t) d->multiple);
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, (block_sector_t) (sec_no + i));
+      input_sectors (c, buffer, block_cnt);
+      buffer += block_cnt * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER in PIO mode, with one command and one interrupt per
+   D->multiple sectors.  D's channel must be locked. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+           const void *buffer_)
+{
+  struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple > 1 ? CMD_WRITE_MULTIPLE
+                         : CMD_WRITE_SECTOR_RETRY));
+  for (i = 0; i < cnt; i += d->multiple) 
+    {
+      size_t block_cnt = (cnt - i < (size_t) d->multiple
+                          ? cnt - i : (size_t) d->multiple);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, (block_sector_t) (sec_no + i));
+      output_sectors (c, buffer, block_cnt);
+      buffer += block_cnt * BLOCK_SECTOR_SIZE;
+      sema_down (&c->completion_wait);
+    }
+}
+
+/* Fills in channel C's PRD table to describe the SIZE bytes of
+   kernel memory at BUFFER. */
+static void
+build_prd_table (struct channel *c, const void *buffer, size_t size) 
+{
+  uintptr_t addr = vtop (buffer);
+  struct prd *prd = c->prd;
+
+  while (size > 0) 
+    {
+      size_t region_size = 0x10000 - (addr & 0xffff);
+      if (region_size > size)
+        region_size = size;
+
+      ASSERT (prd < c->prd + PRD_CNT);
+      prd->addr = addr;
+      prd->size = region_size & 0xffff;
+      prd->flags = 0;
+      prd++;
+
+      addr += region_size;
+      size -= region_size;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and BUFFER by bus-master DMA, from BUFFER to the disk if WRITE
+   is true and the other way otherwise.  D's channel must be
+   locked. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *buffer, bool write) 
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  /* Point the controller at the buffer and clear its status. */
+  build_prd_table (c, buffer, cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prd));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+
+  /* Issue the command, then start the transfer and wait for the
+     interrupt that says it is done. */
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+  if ((bm_status & BM_STA_ERR) != 0
+      || (inb (reg_alt_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
@@ -414,20 +781,22 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
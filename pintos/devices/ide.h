@@ -1,6 +1,12 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Controlled by kernel command-line option "-pio". */
+extern bool ide_use_pio;
+
 void ide_init (void);
+void ide_print_stats (void);
 
 #endif /* devices/ide.h */
@@ -91,7 +91,17 @@ timer_sleep (int64_t ticks)
 {
   int64_t start = timer_ticks ();
   ASSERT (intr_get_level () == INTR_ON);
-  thread_sleep(start + ticks);
+  timer_sleep_until (start + ticks);
+}
+
+/* Sleeps until the timer tick count reaches DEADLINE, a value
+   on the same scale as timer_ticks().  Returns immediately if
+   DEADLINE has already passed.  Interrupts must be turned on. */
+void
+timer_sleep_until (int64_t deadline) 
+{
+  ASSERT (intr_get_level () == INTR_ON);
+  thread_sleep (deadline);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
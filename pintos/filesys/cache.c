@@ -0,0 +1,610 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/lockstat.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache for sectors of the file system device.
+
+   All file system I/O goes through a fixed set of cache entries,
+   each holding one sector.  Reads are satisfied from the cache
+   when possible, and writes only modify the cached copy and mark
+   it dirty.  Dirty sectors reach the disk when they are evicted,
+   when the flusher thread wakes up every CACHE_FLUSH_INTERVAL
+   ticks, or when the file system is shut down.  Victims are
+   chosen by the clock algorithm.
+
+   cache_lock protects the entries' bookkeeping: which sector each
+   holds, whether it is dirty, and how many threads are using it.
+   Each entry's data is protected by its own reader-writer lock,
+   so that accesses to different sectors, or reads of the same
+   sector, do not wait for each other.  A thread that is using an
+   entry "pins" it, which keeps it from being evicted.  No disk
+   I/O is done with cache_lock held: a thread that needs an entry
+   while every one is pinned, or a sector whose old copy is still
+   being written back, waits on cache_cond.
+
+   Sectors that are likely to be read soon can be queued with
+   cache_readahead().  A read-ahead thread brings them into the
+   cache in the background, so that the reader later finds them
+   there instead of waiting for the disk.
+
+   The flusher and the read-ahead thread submit all the requests
+   they have at hand to the block layer before waiting for any of
+   them, so that the disk can serve them in the order it likes
+   and merge adjacent ones.
+
+   Sectors written with cache_log_at() belong to the journal's
+   running transaction.  They are "logged": they must not reach
+   their place on disk before the transaction commits, so they
+   are neither evicted nor flushed until cache_unlog(). */
+
+/* Number of sectors in the cache. */
+#define CACHE_CNT 64
+
+/* How often, in timer ticks, the flusher writes dirty sectors. */
+#define CACHE_FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Maximum number of queued read-ahead requests. */
+#define READAHEAD_CNT 32
+
+/* Maximum number of read-ahead requests submitted at once. */
+#define READAHEAD_BATCH 8
+
+/* Sector number of an entry that holds no sector. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* A cache entry. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, or NO_SECTOR. */
+    block_sector_t evicting;    /* Old sector being written back. */
+    bool dirty;                 /* Modified since read or written? */
+    bool accessed;              /* Used since the clock hand passed? */
+    bool logged;                /* In an uncommitted transaction? */
+    unsigned pin_cnt;           /* Number of threads using it. */
+    struct rwlock data_lock;    /* Protects DATA. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+    struct block_request io;    /* For flushing or reading ahead. */
+  };
+
+static struct cache_entry cache[CACHE_CNT];
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Signaled when an entry is unpinned or unlogged, or finishes
+   writing back an evicted sector. */
+static struct condition cache_cond;
+
+/* Serializes cache_flush(), which uses the entries' IO. */
+static struct lock flush_lock;
+
+/* Read-ahead queue, a circular buffer of sectors to fetch. */
+static block_sector_t readahead_queue[READAHEAD_CNT];
+static size_t readahead_head, readahead_tail;
+static struct lock readahead_lock;
+static struct condition readahead_cond;
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, evict_cnt, writeback_cnt;
+static unsigned long long readahead_cnt, readahead_drop_cnt;
+
+static struct cache_entry *cache_get (block_sector_t, bool write,
+                                      bool need_data);
+static void cache_put (struct cache_entry *, bool write);
+static struct cache_entry *lookup (block_sector_t);
+static bool is_evicting (block_sector_t);
+static struct cache_entry *choose_victim (void);
+static void take_over (struct cache_entry *, block_sector_t);
+static void flush (const block_sector_t sectors[], size_t cnt);
+static thread_func flusher, readahead_worker;
+
+/* Initializes the buffer cache and starts its flusher thread. */
+void
+cache_init (void) 
+{
+  size_t per_page = PGSIZE / BLOCK_SECTOR_SIZE;
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT, CACHE_CNT / per_page);
+  lock_init (&cache_lock);
+  cond_init (&cache_cond);
+  lock_init (&flush_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &cache[i];
+      e->sector = NO_SECTOR;
+      e->evicting = NO_SECTOR;
+      e->dirty = false;
+      e->accessed = false;
+      e->logged = false;
+      e->pin_cnt = 0;
+      rwlock_init (&e->data_lock, RWLOCK_PREFER_WRITERS);
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+
+  readahead_head = readahead_tail = 0;
+  lock_init (&readahead_lock);
+  cond_init (&readahead_cond);
+
+  thread_create ("cache-flush", PRI_DEFAULT, flusher, NULL, 0);
+  thread_create ("cache-readahead", PRI_DEFAULT, readahead_worker, NULL, 0);
+}
+
+/* Reads sector SECTOR of the file system device into BUFFER,
+   which must have room for BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer) 
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within sector
+   SECTOR of the file system device into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, off_t ofs, off_t size) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, false, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR of
+   the file system device. */
+void
+cache_write (block_sector_t sector, const void *buffer) 
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within sector
+   SECTOR of the file system device, and marks the sector logged
+   if LOG is true. */
+static void
+write_at (block_sector_t sector, const void *buffer, off_t ofs, off_t size,
+          bool log) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* There is no need to read the sector if all of it will be
+     overwritten. */
+  e = cache_get (sector, true, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (log) 
+    {
+      lock_acquire (&cache_lock);
+      e->logged = true;
+      lock_release (&cache_lock);
+    }
+  cache_put (e, true);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within sector
+   SECTOR of the file system device.  The rest of the sector is
+   unchanged. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                off_t ofs, off_t size) 
+{
+  write_at (sector, buffer, ofs, size, false);
+}
+
+/* Like cache_write_at(), but also marks SECTOR logged, so that it
+   stays in the cache and is not written to disk until
+   cache_unlog() is called for it. */
+void
+cache_log_at (block_sector_t sector, const void *buffer,
+              off_t ofs, off_t size) 
+{
+  write_at (sector, buffer, ofs, size, true);
+}
+
+/* Allows SECTOR, which must be logged, to be written to disk and
+   evicted again. */
+void
+cache_unlog (block_sector_t sector) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  ASSERT (e != NULL && e->logged);
+  e->logged = false;
+  cond_broadcast (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR of the file system device to be brought into
+   the cache in the background, and returns without waiting.
+   The request is dropped if too many are already queued. */
+void
+cache_readahead (block_sector_t sector) 
+{
+  size_t next;
+
+  lock_acquire (&readahead_lock);
+  next = (readahead_head + 1) % READAHEAD_CNT;
+  if (next != readahead_tail) 
+    {
+      readahead_queue[readahead_head] = sector;
+      readahead_head = next;
+      cond_signal (&readahead_cond, &readahead_lock);
+    }
+  else
+    readahead_drop_cnt++;
+  lock_release (&readahead_lock);
+}
+
+/* Writes every dirty sector in the cache to disk, except those
+   that are logged. */
+void
+cache_flush (void) 
+{
+  flush (NULL, 0);
+}
+
+/* Writes those of the CNT SECTORS that are dirty in the cache,
+   and not logged, to disk. */
+void
+cache_flush_sectors (const block_sector_t sectors[], size_t cnt) 
+{
+  flush (sectors, cnt);
+}
+
+/* Returns true if SECTOR is one of the CNT SECTORS, or if
+   SECTORS is a null pointer. */
+static bool
+is_wanted (block_sector_t sector, const block_sector_t sectors[], size_t cnt)
+{
+  size_t i;
+
+  if (sectors == NULL)
+    return true;
+  for (i = 0; i < cnt; i++)
+    if (sectors[i] == sector)
+      return true;
+  return false;
+}
+
+/* Writes the dirty sectors in the cache that are not logged and
+   are among the CNT SECTORS, or all of them if SECTORS is a null
+   pointer, to disk. */
+static void
+flush (const block_sector_t sectors[], size_t cnt) 
+{
+  bool submitted[CACHE_CNT];
+  size_t i;
+
+  lock_acquire (&flush_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &cache[i];
+
+      submitted[i] = false;
+      lock_acquire (&cache_lock);
+      if (e->sector == NO_SECTOR || !e->dirty || e->logged
+          || !is_wanted (e->sector, sectors, cnt)) 
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      /* Holding the data lock for reading keeps writers out, so
+         DIRTY and LOGGED cannot be set again until the write is
+         done. */
+      rwlock_acquire_read (&e->data_lock);
+      if (e->dirty && !e->logged) 
+        {
+          e->dirty = false;
+          block_request_init (&e->io, true, e->sector, 1, e->data,
+                              NULL, NULL);
+          block_submit (fs_device, &e->io);
+          writeback_cnt++;
+          submitted[i] = true;
+        }
+      else
+        cache_put (e, false);
+    }
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (submitted[i]) 
+      {
+        block_wait (&cache[i].io);
+        cache_put (&cache[i], false);
+      }
+
+  /* Evicted sectors being written back were dirty too. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      block_sector_t evicting = cache[i].evicting;
+      while (evicting != NO_SECTOR && cache[i].evicting == evicting
+             && is_wanted (evicting, sectors, cnt))
+        cond_wait (&cache_cond, &cache_lock);
+    }
+  lock_release (&cache_lock);
+  lock_release (&flush_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void) 
+{
+  printf ("Cache: %llu hits, %llu misses, %llu evictions, "
+          "%llu write-backs\n",
+          hit_cnt, miss_cnt, evict_cnt, writeback_cnt);
+  printf ("Cache: %llu sectors read ahead, %llu read-ahead requests "
+          "dropped\n", readahead_cnt, readahead_drop_cnt);
+  if (lockstat_enabled)
+    {
+      lock_stats_print (&cache_lock.stats, "Cache: cache_lock");
+      lock_stats_print (&flush_lock.stats, "Cache: flush_lock");
+      lock_stats_print (&readahead_lock.stats, "Cache: readahead_lock");
+    }
+}
+
+/* Returns the cache entry for SECTOR, pinned and with its data
+   lock held for writing if WRITE is true or for reading
+   otherwise.  If the sector is not cached, evicts another sector
+   to make room for it and, if NEED_DATA is true, reads it from
+   disk. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool write, bool need_data) 
+{
+  struct cache_entry *e;
+
+  ASSERT (sector != NO_SECTOR);
+
+  lock_acquire (&cache_lock);
+  for (;;) 
+    {
+      e = lookup (sector);
+      if (e != NULL) 
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          hit_cnt++;
+          lock_release (&cache_lock);
+
+          if (write)
+            rwlock_acquire_write (&e->data_lock);
+          else
+            rwlock_acquire_read (&e->data_lock);
+          return e;
+        }
+
+      /* If SECTOR's old copy is still being written back, reading
+         it from disk now would return stale data.  Otherwise, if
+         every entry is pinned or logged, let their users finish.
+         Either way, look again afterward, since another thread
+         may have brought in SECTOR in the meantime. */
+      if (!is_evicting (sector)) 
+        {
+          e = choose_victim ();
+          if (e != NULL)
+            break;
+        }
+      cond_wait (&cache_cond, &cache_lock);
+    }
+
+  /* Miss. */
+  take_over (e, sector);
+  if (need_data)
+    block_read (fs_device, sector, e->data);
+  if (!write) 
+    {
+      /* Trade the write lock for a read lock.  Another writer may
+         slip in between, but any writer leaves valid data. */
+      rwlock_release_write (&e->data_lock);
+      rwlock_acquire_read (&e->data_lock);
+    }
+  return e;
+}
+
+/* Releases entry E, which was obtained from cache_get() with the
+   same value of WRITE. */
+static void
+cache_put (struct cache_entry *e, bool write) 
+{
+  if (write)
+    rwlock_release_write (&e->data_lock);
+  else
+    rwlock_release_read (&e->data_lock);
+
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Makes entry E, just chosen by choose_victim(), hold SECTOR
+   instead of its old contents, and returns with E pinned, its
+   data lock held for writing, and cache_lock released.  Does not
+   read SECTOR.  cache_lock must be held.
+
+   No other thread is using E, so its data lock is free; holding
+   it until the new sector's data is in place makes any thread
+   that finds the entry in the meantime wait for the data.  Dirty
+   old contents are written back after cache_lock is released,
+   with E's EVICTING set meanwhile, so that no one reads that
+   sector from disk before it is up to date. */
+static void
+take_over (struct cache_entry *e, block_sector_t sector) 
+{
+  block_sector_t old = e->sector;
+  bool write_back = old != NO_SECTOR && e->dirty;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  miss_cnt++;
+  rwlock_acquire_write (&e->data_lock);
+  if (old != NO_SECTOR)
+    evict_cnt++;
+  if (write_back) 
+    {
+      e->evicting = old;
+      writeback_cnt++;
+    }
+  e->sector = sector;
+  e->dirty = false;
+  e->logged = false;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  lock_release (&cache_lock);
+
+  if (write_back) 
+    {
+      block_write (fs_device, old, e->data);
+      lock_acquire (&cache_lock);
+      e->evicting = NO_SECTOR;
+      cond_broadcast (&cache_cond, &cache_lock);
+      lock_release (&cache_lock);
+    }
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer if
+   SECTOR is not cached.  cache_lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns true if SECTOR's old copy is being written back from
+   an entry that now holds another sector.  cache_lock must be
+   held. */
+static bool
+is_evicting (block_sector_t sector) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].evicting == sector)
+      return true;
+  return false;
+}
+
+/* Chooses an entry to hold a new sector, using the clock
+   algorithm, and returns it.  Empty entries are taken first.
+   Returns a null pointer if every entry is pinned or logged.
+   cache_lock must be held. */
+static struct cache_entry *
+choose_victim (void) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].sector == NO_SECTOR && cache[i].pin_cnt == 0)
+      return &cache[i];
+
+  /* Two full sweeps are enough to find an unpinned entry if
+     there is one. */
+  for (i = 0; i < 2 * CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_CNT;
+      if (e->pin_cnt > 0 || e->logged)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Flusher thread.  Periodically writes dirty sectors back to
+   disk, so that they are not lost if the machine stops without
+   shutting down the file system, and so that eviction seldom
+   has to wait for a write. */
+static void
+flusher (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      timer_sleep (CACHE_FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Fetches the sectors queued by
+   cache_readahead() that are not already cached, up to
+   READAHEAD_BATCH at a time.  A sector for which no entry can be
+   taken over without waiting is dropped. */
+static void
+readahead_worker (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      block_sector_t sectors[READAHEAD_BATCH];
+      struct cache_entry *entries[READAHEAD_BATCH];
+      size_t sector_cnt = 0;
+      size_t entry_cnt = 0;
+      size_t i;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_head == readahead_tail)
+        cond_wait (&readahead_cond, &readahead_lock);
+      while (readahead_head != readahead_tail
+             && sector_cnt < READAHEAD_BATCH) 
+        {
+          sectors[sector_cnt++] = readahead_queue[readahead_tail];
+          readahead_tail = (readahead_tail + 1) % READAHEAD_CNT;
+        }
+      lock_release (&readahead_lock);
+
+      for (i = 0; i < sector_cnt; i++) 
+        {
+          struct cache_entry *e;
+
+          lock_acquire (&cache_lock);
+          if (lookup (sectors[i]) != NULL || is_evicting (sectors[i])
+              || (e = choose_victim ()) == NULL) 
+            {
+              lock_release (&cache_lock);
+              continue;
+            }
+          take_over (e, sectors[i]);
+          block_request_init (&e->io, false, sectors[i], 1, e->data,
+                              NULL, NULL);
+          block_submit (fs_device, &e->io);
+          entries[entry_cnt++] = e;
+          readahead_cnt++;
+        }
+
+      for (i = 0; i < entry_cnt; i++) 
+        {
+          block_wait (&entries[i]->io);
+          cache_put (entries[i], true);
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/lockstat.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of looking up names in directories, so
+   that walking the same path again does not have to open each
+   directory along the way.  An entry maps a directory's inode
+   sector and a name to the inode sector the name refers to, or
+   records that the directory has no entry by that name (a
+   "negative" entry, with sector 0, which is the free map's inode
+   and so never a file).
+
+   The directory code keeps the cache consistent: adding or
+   removing a name invalidates the cached entry for it, and
+   removing a directory invalidates every entry under it.  At
+   most DCACHE_CNT entries are kept; the least recently used one
+   is discarded to make room for a new one.
+
+   dcache_lock protects the cache.  A lookup does not hold it
+   while it opens the inode it finds, which may read the disk.
+   The file may be removed, and its sector reused, in the
+   meantime, so afterward the lookup checks that the entry is
+   still cached: removing a file invalidates its entry before the
+   file's last opener can release its sector. */
+
+/* Maximum number of cached entries. */
+#define DCACHE_CNT 256
+
+/* A cached directory entry. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t parent;              /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t sector;              /* File's inode sector, or 0. */
+  };
+
+/* Cached entries, hashed on parent and name. */
+static struct hash dentries;
+
+/* Cached entries, most recently used first. */
+static struct list lru_list;
+
+static struct kmem_cache *dentry_cache;
+static struct lock dcache_lock;
+
+/* Statistics. */
+static unsigned long long hit_cnt, negative_hit_cnt, miss_cnt;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t parent, const char *name);
+static void discard (struct dentry *);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+  dentry_cache = kmem_cache_create ("dentry", sizeof (struct dentry), NULL);
+  if (dentry_cache == NULL
+      || !hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("dcache_init: out of memory");
+}
+
+/* Looks up NAME in the directory whose inode is in sector
+   PARENT.  If the cache knows the answer, returns true and sets
+   *INODE to the file's inode, which the caller must close, or to
+   a null pointer if the directory has no file named NAME.
+   Returns false if the answer is not cached. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               struct inode **inode) 
+{
+  struct dentry *d;
+  block_sector_t sector;
+  struct inode *opened;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  sector = d != NULL ? d->sector : 0;
+  if (d != NULL && sector == 0)
+    {
+      negative_hit_cnt++;
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      lock_release (&dcache_lock);
+      *inode = NULL;
+      return true;
+    }
+  lock_release (&dcache_lock);
+  if (d == NULL)
+    goto miss;
+
+  /* Open the inode, then make sure NAME still refers to it. */
+  opened = inode_open (sector);
+  if (opened == NULL)
+    goto miss;
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d == NULL || d->sector != sector)
+    {
+      lock_release (&dcache_lock);
+      inode_close (opened);
+      goto miss;
+    }
+  hit_cnt++;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+  *inode = opened;
+  return true;
+
+ miss:
+  lock_acquire (&dcache_lock);
+  miss_cnt++;
+  lock_release (&dcache_lock);
+  return false;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT refers to the inode in SECTOR or, if SECTOR is 0, that
+   the directory has no file named NAME.  The caller must hold
+   the directory's lock, so that the entry cannot change in the
+   meantime. */
+void
+dcache_add (block_sector_t parent, const char *name, block_sector_t sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (hash_size (&dentries) >= DCACHE_CNT)
+        discard (list_entry (list_back (&lru_list), struct dentry, lru_elem));
+      d = kmem_cache_alloc (dentry_cache);
+      if (d == NULL)
+        {
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  list_push_front (&lru_list, &d->lru_elem);
+  d->sector = sector;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name) 
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every cached entry in the directory whose inode is in
+   sector DIR. */
+void
+dcache_invalidate_dir (block_sector_t dir) 
+{
+  struct list_elem *e;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); )
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      e = list_next (e);
+      if (d->parent == dir)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void) 
+{
+  printf ("Dentry cache: %llu hits, %llu negative hits, %llu misses\n",
+          hit_cnt, negative_hit_cnt, miss_cnt);
+  if (lockstat_enabled)
+    lock_stats_print (&dcache_lock.stats, "Dentry cache: dcache_lock");
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null pointer
+   if there is none.  dcache_lock must be held. */
+static struct dentry *
+find (block_sector_t parent, const char *name) 
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.  dcache_lock must be
+   held. */
+static void
+discard (struct dentry *d) 
+{
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  kmem_cache_free (dentry_cache, d);
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_int (d->parent) ^ hash_string (d->name);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
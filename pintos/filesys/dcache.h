@@ -0,0 +1,18 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+struct inode;
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    struct inode **);
+void dcache_add (block_sector_t parent, const char *name,
+                 block_sector_t sector);
+void dcache_invalidate (block_sector_t parent, const char *name);
+void dcache_invalidate_dir (block_sector_t dir);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
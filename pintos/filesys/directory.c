@@ -1,16 +1,56 @@
 #include "filesys/directory.h"
+#include <debug.h>
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Directories are hash tables on disk.
+
+   A directory's data is an array of buckets, each one sector
+   long and holding ENTRIES_PER_BUCKET directory entries.  An
+   entry goes in the bucket selected by the hash of its name or,
+   if that bucket is full, in the next bucket with a free slot,
+   wrapping around at the end.  A bucket that an entry had to skip
+   over is marked as having overflowed, so that a search can stop
+   at the first bucket that has not.  When a directory becomes
+   three-quarters full, its number of buckets is doubled: its
+   entries are rehashed into new sectors, which then replace the
+   old ones all at once.
+
+   In addition, while a directory is open, and for a while
+   afterward, its entries are kept in an in-memory hash table, so
+   that lookups need not read the disk at all.  The table is
+   built the first time the directory is opened.
+
+   Every directory contains entries "." and "..", for itself and
+   its parent, so that relative paths can name them; the root
+   directory is its own parent.  dir_readdir() does not return
+   them.
+
+   Each directory's inode has a reader-writer lock, taken by every
+   operation on the directory's entries, so that operations on
+   different directories proceed in parallel.  Lookups, reads and
+   building the index take it for reading, so that they also
+   proceed in parallel within a directory; adding and removing
+   entries, and growing the directory, take it for writing.
+   dir_remove() of a directory takes its lock for writing too,
+   always after its parent's.  index_lock protects index_list,
+   forgotten_list and the indexes' use counts. */
 
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    struct dir_index *index;            /* In-memory index, or null. */
   };
 
 /* A single directory entry. */
@@ -21,30 +61,129 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Number of entries in a bucket. */
+#define ENTRIES_PER_BUCKET \
+        ((BLOCK_SECTOR_SIZE - sizeof (bool)) / sizeof (struct dir_entry))
+
+/* On-disk bucket.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct dir_bucket
+  {
+    struct dir_entry entries[ENTRIES_PER_BUCKET];
+    bool overflowed;                    /* Entry placed past here? */
+    uint8_t unused[BLOCK_SECTOR_SIZE - sizeof (bool)
+                   - ENTRIES_PER_BUCKET * sizeof (struct dir_entry)];
+  };
+
+/* In-memory index of a directory's entries. */
+struct dir_index
+  {
+    struct list_elem elem;              /* Element in index_list or
+                                           forgotten_list. */
+    bool listed;                        /* In index_list? */
+    block_sector_t inumber;             /* Directory's inode sector. */
+    int open_cnt;                       /* Number of dirs using it. */
+    struct hash entries;                /* Contains struct index_entry. */
+  };
+
+/* An entry in a directory's in-memory index. */
+struct index_entry
+  {
+    struct hash_elem elem;              /* Element in dir_index. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of on-disk entry. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* Number of indexes of directories that are no longer open to
+   keep around, in case the directories are opened again. */
+#define INDEX_KEEP 8
+
+/* Indexes, most recently used first. */
+static struct list index_list;
+static struct lock index_lock;
+
+/* Indexes that have been discarded but are still in use.  No new
+   index is built for a directory that has one: the `struct dir's
+   using it make their changes on disk only, so a new index would
+   miss them. */
+static struct list forgotten_list;
+
+/* Caches of `struct dir's, buckets and index entries. */
+static struct kmem_cache *dir_cache;
+static struct kmem_cache *bucket_cache;
+static struct kmem_cache *index_entry_cache;
+
+static struct dir_index *index_get (struct inode *);
+static void index_put (struct dir_index *);
+static void index_forget (block_sector_t inumber);
+static bool index_add (struct dir_index *, const struct dir_entry *,
+                       off_t ofs);
+static struct index_entry *index_find (struct dir_index *, const char *);
+static void index_clear (struct dir_index *);
+static bool index_read (struct dir_index *, struct inode *);
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  ASSERT (sizeof (struct dir_bucket) == BLOCK_SECTOR_SIZE);
+
+  list_init (&index_list);
+  list_init (&forgotten_list);
+  lock_init (&index_lock);
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+  bucket_cache = kmem_cache_create ("dir-bucket",
+                                    sizeof (struct dir_bucket), NULL);
+  index_entry_cache = kmem_cache_create ("dir-index",
+                                         sizeof (struct index_entry), NULL);
+  if (dir_cache == NULL || bucket_cache == NULL || index_entry_cache == NULL)
+    PANIC ("dir_init: out of memory");
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory's inode is in sector
+   PARENT.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t bucket_cnt = DIV_ROUND_UP (entry_cnt + 2, ENTRIES_PER_BUCKET);
+  struct dir *dir;
+  bool success;
+
+  /* An index of an earlier directory in SECTOR would be stale,
+     and so would cached entries of it. */
+  index_forget (sector);
+  dcache_invalidate_dir (sector);
+  if (!inode_create (sector, bucket_cnt * BLOCK_SECTOR_SIZE, true))
+    return false;
+
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure,
+   including if INODE is not a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  struct dir *dir = kmem_cache_alloc (dir_cache);
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
+      dir->index = index_get (inode);
       return dir;
     }
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -71,8 +210,10 @@ dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
+      if (dir->index != NULL)
+        index_put (dir->index);
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,7 +224,95 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Returns DIR's in-memory index, or a null pointer if it has
+   none or its index has been discarded.  The caller must hold
+   DIR's lock. */
+static struct dir_index *
+dir_index (const struct dir *dir)
+{
+  return dir->index != NULL && dir->index->listed ? dir->index : NULL;
+}
+
+/* Returns the number of buckets in DIR. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that an entry named NAME belongs in, in a
+   directory with BUCKET_CNT buckets. */
+static size_t
+home_bucket (const char *name, size_t bucket_cnt)
+{
+  return hash_string (name) % bucket_cnt;
+}
+
+/* Returns the byte offset of entry SLOT in bucket BUCKET. */
+static off_t
+entry_ofs (size_t bucket, size_t slot)
+{
+  return bucket * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/* Reads bucket number BUCKET of DIR into *B.  Returns true if
+   successful, false on failure. */
+static bool
+read_bucket (const struct dir *dir, size_t bucket, struct dir_bucket *b)
+{
+  return inode_read_at (dir->inode, b, sizeof *b,
+                        bucket * BLOCK_SECTOR_SIZE) == sizeof *b;
+}
+
+/* Searches DIR's buckets on disk for a file with the given NAME.
+   If successful, returns true, sets *EP to the directory entry
+   if EP is non-null, and sets *OFSP to the byte offset of the
+   directory entry if OFSP is non-null.
+   otherwise, returns false and ignores EP and OFSP. */
+static bool
+disk_lookup (const struct dir *dir, const char *name,
+             struct dir_entry *ep, off_t *ofsp)
+{
+  size_t cnt = bucket_cnt (dir);
+  struct dir_bucket *b;
+  bool found = false;
+  size_t home, i, slot;
+
+  if (cnt == 0)
+    return false;
+  home = home_bucket (name, cnt);
+  b = kmem_cache_alloc (bucket_cache);
+  if (b == NULL)
+    return false;
+
+  for (i = 0; i < cnt && !found; i++)
+    {
+      size_t bucket = (home + i) % cnt;
+      if (!read_bucket (dir, bucket, b))
+        break;
+      for (slot = 0; slot < ENTRIES_PER_BUCKET; slot++)
+        {
+          struct dir_entry *e = &b->entries[slot];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = entry_ofs (bucket, slot);
+              found = true;
+              break;
+            }
+        }
+      if (!b->overflowed)
+        break;
+    }
+
+  kmem_cache_free (bucket_cache, b);
+  return found;
+}
+
+/* Searches DIR for a file with the given NAME, using DIR's
+   in-memory index if it has one.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
@@ -92,42 +321,170 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct dir_index *index = dir_index (dir);
+  struct index_entry *ie;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (index == NULL)
+    return disk_lookup (dir, name, ep, ofsp);
+
+  ie = index_find (index, name);
+  if (ie == NULL)
+    return false;
+  if (ep != NULL)
+    {
+      ep->inode_sector = ie->inode_sector;
+      strlcpy (ep->name, ie->name, sizeof ep->name);
+      ep->in_use = true;
+    }
+  if (ofsp != NULL)
+    *ofsp = ie->ofs;
+  return true;
+}
+
+/* Writes entry E into the first free slot of DIR's buckets,
+   starting from its home bucket, and stores its offset in *OFSP.
+   Returns true if successful, false if every bucket is full or a
+   disk or memory error occurs. */
+static bool
+disk_insert (struct dir *dir, const struct dir_entry *e, off_t *ofsp)
+{
+  size_t cnt = bucket_cnt (dir);
+  struct dir_bucket *b;
+  bool success = false;
+  size_t home, i, slot;
+
+  if (cnt == 0)
+    return false;
+  home = home_bucket (e->name, cnt);
+  b = kmem_cache_alloc (bucket_cache);
+  if (b == NULL)
+    return false;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t bucket = (home + i) % cnt;
+      if (!read_bucket (dir, bucket, b))
+        break;
+      for (slot = 0; slot < ENTRIES_PER_BUCKET; slot++)
+        if (!b->entries[slot].in_use)
+          break;
+      if (slot < ENTRIES_PER_BUCKET)
+        {
+          *ofsp = entry_ofs (bucket, slot);
+          success = inode_write_at (dir->inode, e, sizeof *e, *ofsp)
+                    == sizeof *e;
+          break;
+        }
+
+      /* Bucket is full, so E goes past it. */
+      if (!b->overflowed)
+        {
+          b->overflowed = true;
+          if (inode_write_at (dir->inode, &b->overflowed,
+                              sizeof b->overflowed,
+                              bucket * BLOCK_SECTOR_SIZE
+                              + offsetof (struct dir_bucket, overflowed))
+              != sizeof b->overflowed)
+            break;
+        }
+    }
+
+  kmem_cache_free (bucket_cache, b);
+  return success;
+}
+
+/* Doubles the number of buckets in DIR and rehashes its entries
+   into them.  Returns true if successful, false on failure.
+
+   The new buckets are filled in a scratch inode, which is then
+   swapped with DIR's inode in a single transaction.  If the disk
+   fills up, DIR is left as it was; if the system stops, DIR has
+   either all of its old buckets or all of its new ones.  The
+   scratch inode's buckets are written like file data, not
+   journaled, so growing a large directory does not overflow the
+   running transaction. */
+static bool
+grow (struct dir *dir)
+{
+  size_t old_cnt = bucket_cnt (dir);
+  size_t new_cnt = old_cnt > 0 ? old_cnt * 2 : 1;
+  struct dir_index *index = dir_index (dir);
+  struct dir new;
+  struct dir_bucket *b;
+  bool success;
+  size_t i, slot;
+
+  b = kmem_cache_alloc (bucket_cache);
+  if (b == NULL)
+    return false;
+  new.inode = inode_create_scratch (dir->inode, new_cnt * BLOCK_SECTOR_SIZE);
+  new.pos = 0;
+  new.index = NULL;
+  success = new.inode != NULL;
+
+  /* Copy the entries into the new buckets. */
+  for (i = 0; i < old_cnt && success; i++)
+    {
+      success = read_bucket (dir, i, b);
+      for (slot = 0; success && slot < ENTRIES_PER_BUCKET; slot++)
+        if (b->entries[slot].in_use)
+          {
+            off_t ofs;
+            success = disk_insert (&new, &b->entries[slot], &ofs);
+          }
+    }
+  kmem_cache_free (bucket_cache, b);
+
+  if (success)
+    success = inode_swap_scratch (dir->inode, new.inode);
+  if (!success)
+    {
+      if (new.inode != NULL)
+        inode_drop_scratch (dir->inode, new.inode);
+      return false;
+    }
+
+  /* The entries have new offsets. */
+  if (index != NULL)
+    {
+      index_clear (index);
+      if (!index_read (index, dir->inode))
+        index_forget (index->inumber);
+    }
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Records the result in the dentry cache. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t inumber = inode_get_inumber (dir->inode);
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock_dir (dir->inode, false);
   if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+    {
+      *inode = inode_open (e.inode_sector);
+      if (*inode != NULL)
+        dcache_add (inumber, name, e.inode_sector);
+    }
   else
-    *inode = NULL;
+    {
+      *inode = NULL;
+      dcache_add (inumber, name, 0);
+    }
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,11 +493,12 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), DIR has been removed,
+   or a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,40 +510,70 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that DIR is still in place and NAME is not in use. */
+  inode_lock_dir (dir->inode, true);
+  index = dir_index (dir);
+  if (inode_is_removed (dir->inode) || lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Make room if DIR is getting full. */
+  if (index != NULL
+      && (hash_size (&index->entries) + 1) * 4
+         > bucket_cnt (dir) * ENTRIES_PER_BUCKET * 3)
+    {
+      if (!grow (dir))
+        goto done;
+      index = dir_index (dir);
+    }
+
+  /* Write slot.  If DIR has no index, we only find out that it is
+     full when no slot is left. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = disk_insert (dir, &e, &ofs);
+  if (!success && index == NULL && grow (dir))
+    success = disk_insert (dir, &e, &ofs);
+  if (success && index != NULL && !index_add (index, &e, ofs))
+    {
+      /* Without the new entry the index would be wrong. */
+      index_forget (index->inumber);
+    }
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+static bool readdir (struct dir *, char name[NAME_MAX + 1]);
+
+/* Returns true if the directory in INODE has no entries other
+   than "." and "..".  The caller must hold INODE's directory
+   lock. */
+static bool
+is_empty (struct inode *inode) 
+{
+  struct dir dir;
+  char name[NAME_MAX + 1];
+
+  dir.inode = inode;
+  dir.pos = 0;
+  dir.index = NULL;
+  return !readdir (&dir, name);
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs
+   if there is no file with the given NAME or if it is a
+   directory that is open or not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool locked = false;
   bool success = false;
   off_t ofs;
 
@@ -193,6 +581,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock_dir (dir->inode, true);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -201,36 +590,351 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove a directory that is empty and that nobody,
+     including a process using it as working directory, has
+     open.  Its lock keeps entries from being added to it in the
+     meantime. */
+  if (inode_is_dir (inode))
+    {
+      inode_lock_dir (inode, true);
+      locked = true;
+      if (inode_open_cnt (inode) > 1 || !is_empty (inode))
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  if (inode_write_at (dir->inode, &e.in_use, sizeof e.in_use,
+                      ofs + offsetof (struct dir_entry, in_use))
+      != sizeof e.in_use)
     goto done;
+  if (dir_index (dir) != NULL)
+    {
+      struct index_entry *ie = index_find (dir->index, name);
+      hash_delete (&dir->index->entries, &ie->elem);
+      kmem_cache_free (index_entry_cache, ie);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
+  index_forget (e.inode_sector);
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (e.inode_sector);
   success = true;
 
  done:
+  if (locked)
+    inode_unlock_dir (inode);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Reads the next directory entry in DIR, other than "." and
+   "..", and stores the name in NAME.  Returns true if
+   successful, false if the directory contains no more
+   entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool success;
+
+  inode_lock_dir (dir->inode, false);
+  success = readdir (dir, name);
+  inode_unlock_dir (dir->inode);
+  return success;
+}
+
+/* Does the work of dir_readdir() for a caller that holds DIR's
+   lock. */
+static bool
+readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  for (;;)
     {
+      size_t bucket = dir->pos / BLOCK_SECTOR_SIZE;
+      size_t slot = dir->pos % BLOCK_SECTOR_SIZE / sizeof e;
+
+      /* Skip the end of each bucket. */
+      if (slot >= ENTRIES_PER_BUCKET)
+        {
+          dir->pos = (bucket + 1) * BLOCK_SECTOR_SIZE;
+          continue;
+        }
+
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        return false;
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
-        } 
+        }
+    }
+}
+
+/* In-memory indexes. */
+
+static hash_hash_func index_entry_hash;
+static hash_less_func index_entry_less;
+static hash_action_func index_entry_free;
+static void index_destroy (struct dir_index *);
+static struct dir_index *index_find_listed (block_sector_t inumber);
+static bool index_is_forgotten (block_sector_t inumber);
+
+/* Returns the index for the directory in INODE, building it if
+   necessary, and marks it in use.  Returns a null pointer if
+   memory is short or if an index of the directory that was
+   discarded is still in use.  The directory's lock is held for reading
+   while the index is built, so that no entry changes in the
+   meantime; another reader may build it at the same time, in
+   which case the first one to finish wins. */
+static struct dir_index *
+index_get (struct inode *inode)
+{
+  block_sector_t inumber = inode_get_inumber (inode);
+  struct dir_index *index, *other;
+
+  inode_lock_dir (inode, false);
+  lock_acquire (&index_lock);
+  index = index_find_listed (inumber);
+  if (index != NULL)
+    goto done;
+  lock_release (&index_lock);
+  if (index_is_forgotten (inumber))
+    goto fail;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    goto fail;
+  if (!hash_init (&index->entries, index_entry_hash, index_entry_less, NULL))
+    {
+      free (index);
+      index = NULL;
+      goto fail;
+    }
+  index->inumber = inumber;
+  index->open_cnt = 0;
+
+  if (!index_read (index, inode))
+    {
+      index_destroy (index);
+      index = NULL;
+      goto fail;
+    }
+
+  lock_acquire (&index_lock);
+  other = index_find_listed (inumber);
+  if (other != NULL)
+    {
+      index_destroy (index);
+      index = other;
+      goto done;
+    }
+  list_push_front (&index_list, &index->elem);
+  index->listed = true;
+
+ done:
+  index->open_cnt++;
+  lock_release (&index_lock);
+ fail:
+  inode_unlock_dir (inode);
+  return index;
+}
+
+/* Returns the index in index_list for the directory whose inode
+   is in sector INUMBER, moving it to the front, or a null
+   pointer if there is none.  index_lock must be held. */
+static struct dir_index *
+index_find_listed (block_sector_t inumber) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&index_list); e != list_end (&index_list);
+       e = list_next (e))
+    {
+      struct dir_index *index = list_entry (e, struct dir_index, elem);
+      if (index->inumber == inumber)
+        {
+          list_remove (&index->elem);
+          list_push_front (&index_list, &index->elem);
+          return index;
+        }
+    }
+  return NULL;
+}
+
+/* Returns true if an index of the directory whose inode is in
+   sector INUMBER has been discarded but is still in use. */
+static bool
+index_is_forgotten (block_sector_t inumber)
+{
+  struct list_elem *e;
+  bool forgotten = false;
+
+  lock_acquire (&index_lock);
+  for (e = list_begin (&forgotten_list); e != list_end (&forgotten_list);
+       e = list_next (e))
+    if (list_entry (e, struct dir_index, elem)->inumber == inumber)
+      {
+        forgotten = true;
+        break;
+      }
+  lock_release (&index_lock);
+  return forgotten;
+}
+
+/* Marks INDEX no longer in use by one directory.  Destroys the
+   least recently used indexes that are not in use, beyond
+   INDEX_KEEP of them, and INDEX itself if it is no longer in
+   use and has been forgotten. */
+static void
+index_put (struct dir_index *index)
+{
+  struct list_elem *e;
+  size_t kept = 0;
+
+  lock_acquire (&index_lock);
+  ASSERT (index->open_cnt > 0);
+  if (--index->open_cnt == 0 && !index->listed)
+    {
+      list_remove (&index->elem);
+      index_destroy (index);
     }
-  return false;
+  else if (index->open_cnt == 0)
+    for (e = list_begin (&index_list); e != list_end (&index_list); )
+      {
+        struct dir_index *i = list_entry (e, struct dir_index, elem);
+        e = list_next (e);
+        if (i->open_cnt == 0 && ++kept > INDEX_KEEP)
+          {
+            list_remove (&i->elem);
+            index_destroy (i);
+          }
+      }
+  lock_release (&index_lock);
+}
+
+/* Discards the index for the directory whose inode is in sector
+   INUMBER, if there is one.  If it is in use, it moves to
+   forgotten_list and is destroyed when its last user is done
+   with it. */
+static void
+index_forget (block_sector_t inumber)
+{
+  struct list_elem *e;
+
+  lock_acquire (&index_lock);
+  for (e = list_begin (&index_list); e != list_end (&index_list);
+       e = list_next (e))
+    {
+      struct dir_index *index = list_entry (e, struct dir_index, elem);
+      if (index->inumber == inumber)
+        {
+          list_remove (&index->elem);
+          index->listed = false;
+          if (index->open_cnt == 0)
+            index_destroy (index);
+          else
+            list_push_back (&forgotten_list, &index->elem);
+          break;
+        }
+    }
+  lock_release (&index_lock);
+}
+
+/* Adds directory entry E, at byte offset OFS, to INDEX.  Returns
+   true if successful, false if memory is short. */
+static bool
+index_add (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  struct index_entry *ie = kmem_cache_alloc (index_entry_cache);
+  if (ie == NULL)
+    return false;
+  ie->inode_sector = e->inode_sector;
+  ie->ofs = ofs;
+  strlcpy (ie->name, e->name, sizeof ie->name);
+  hash_insert (&index->entries, &ie->elem);
+  return true;
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if it has
+   none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->entries, &key.elem);
+  return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Removes all the entries from INDEX. */
+static void
+index_clear (struct dir_index *index)
+{
+  hash_clear (&index->entries, index_entry_free);
+}
+
+/* Adds every entry of the directory in INODE to INDEX.  Returns
+   true if successful, false if a disk or memory error occurs. */
+static bool
+index_read (struct dir_index *index, struct inode *inode)
+{
+  size_t bucket_cnt = inode_length (inode) / BLOCK_SECTOR_SIZE;
+  struct dir_bucket *b;
+  bool success;
+  size_t i, slot;
+
+  b = kmem_cache_alloc (bucket_cache);
+  success = b != NULL;
+  for (i = 0; i < bucket_cnt && success; i++)
+    {
+      success = inode_read_at (inode, b, sizeof *b,
+                               i * BLOCK_SECTOR_SIZE) == sizeof *b;
+      for (slot = 0; success && slot < ENTRIES_PER_BUCKET; slot++)
+        if (b->entries[slot].in_use)
+          success = index_add (index, &b->entries[slot],
+                               entry_ofs (i, slot));
+    }
+  kmem_cache_free (bucket_cache, b);
+  return success;
+}
+
+/* Frees INDEX, which must not be in use or in a list. */
+static void
+index_destroy (struct dir_index *index)
+{
+  ASSERT (index->open_cnt == 0);
+  hash_destroy (&index->entries, index_entry_free);
+  free (index);
+}
+
+/* Returns a hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+/* Returns true if index entry A's name precedes B's. */
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, elem)->name,
+                 hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED)
+{
+  kmem_cache_free (index_entry_cache,
+                   hash_entry (e, struct index_entry, elem));
 }
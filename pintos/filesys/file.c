@@ -1,7 +1,8 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
 struct file 
@@ -9,26 +10,50 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+
+    /* Read-ahead state.  See read_at(). */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of data already read ahead. */
+    off_t ra_window;            /* Sectors to keep read ahead. */
   };
 
+/* Read-ahead window bounds, in sectors. */
+#define RA_WINDOW_MIN 2
+#define RA_WINDOW_MAX 16
+
+/* Cache of `struct file's. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+  if (file_cache == NULL)
+    PANIC ("file_init: out of memory");
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
@@ -49,7 +74,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      kmem_cache_free (file_cache, file);
     }
 }
 
@@ -60,6 +85,46 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* Reads SIZE bytes from FILE into BUFFER, starting at offset
+   FILE_OFS, and returns the number of bytes read.
+
+   Also keeps the sectors that follow the data read in the buffer
+   cache, if FILE is being read sequentially.  Each read that
+   starts where the previous one left off doubles the number of
+   sectors read ahead, up to RA_WINDOW_MAX, and any other read
+   stops read-ahead until sequential reading resumes. */
+static off_t
+read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
+{
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t next = file_ofs + bytes_read;
+
+  if (file_ofs == file->ra_next && bytes_read > 0) 
+    {
+      off_t want;
+
+      file->ra_window = (file->ra_window == 0 ? RA_WINDOW_MIN
+                         : file->ra_window * 2 < RA_WINDOW_MAX
+                         ? file->ra_window * 2 : RA_WINDOW_MAX);
+      want = next + file->ra_window * BLOCK_SECTOR_SIZE;
+      if (file->ra_end < next)
+        file->ra_end = next;
+      if (want > file->ra_end) 
+        {
+          inode_readahead (file->inode, want - file->ra_end, file->ra_end);
+          file->ra_end = want;
+        }
+    }
+  else 
+    {
+      file->ra_window = 0;
+      file->ra_end = next;
+    }
+  file->ra_next = next;
+
+  return bytes_read;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -68,7 +133,7 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = read_at (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +146,7 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return read_at (file, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
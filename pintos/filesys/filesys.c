@@ -2,15 +2,21 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static struct dir *open_parent (const char *path, char name[NAME_MAX + 1]);
+static struct inode *open_path (const char *path);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +27,12 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  file_init ();
+  dir_init ();
+  dcache_init ();
+  journal_init (format);
   free_map_init ();
 
   if (format) 
@@ -36,6 +47,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,14 +58,47 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = open_parent (name, base);
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, base, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = open_parent (name, base);
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && dir_create (inode_sector, 0,
+                            inode_get_inumber (dir_get_inode (dir)))
+             && dir_add (dir, base, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -66,38 +111,193 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
-
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
-
-  return file_open (inode);
+  return file_open (open_path (name));
 }
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory
+   that is open or not empty, or if an internal memory
+   allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = open_parent (name, base);
+  success = (dir != NULL
+             && strcmp (base, ".") && strcmp (base, "..")
+             && dir_remove (dir, base));
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
 
+/* Changes the running thread's working directory to NAME.
+   Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name) 
+{
+  struct thread *t = thread_current ();
+  struct dir *dir = dir_open (open_path (name));
+
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
 }
+
+/* Path resolution.
+
+   A path is a sequence of file names separated by slashes.  It
+   is looked up starting from the root directory if it begins
+   with a slash, and from the running thread's working directory
+   otherwise.  Each name but the last must be a directory.  The
+   names are looked up through the dentry cache, so a path that
+   was walked recently is resolved without reading the
+   directories along it. */
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Looks up NAME in the directory in DIR_INODE.  Returns the
+   file's inode, which the caller must close, or a null pointer
+   if there is no such file. */
+static struct inode *
+lookup (struct inode *dir_inode, const char *name)
+{
+  struct inode *inode;
+
+  if (!dcache_lookup (inode_get_inumber (dir_inode), name, &inode))
+    {
+      struct dir *dir = dir_open (inode_reopen (dir_inode));
+
+      inode = NULL;
+      if (dir != NULL)
+        dir_lookup (dir, name, &inode);
+      dir_close (dir);
+    }
+  return inode;
+}
+
+/* Resolves all of PATH but its last name, which is stored in
+   NAME, and returns the inode of the directory that should
+   contain it, which the caller must close.  A path with no
+   names, such as "/", is treated as naming "." in its starting
+   directory.  Returns a null pointer if PATH is empty, a name in
+   it is too long, or a directory along it does not exist.
+
+   Each directory along the way is kept open until the next one
+   has been opened, so that none can be removed, and its sector
+   reused, in the middle of the walk. */
+static struct inode *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  struct inode *dir;
+  char next[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  if (*path == '/' || cwd == NULL)
+    dir = inode_open (ROOT_DIR_SECTOR);
+  else
+    dir = inode_reopen (dir_get_inode (cwd));
+
+  strlcpy (name, ".", NAME_MAX + 1);
+  result = get_next_part (name, &path);
+  while (result > 0 && dir != NULL)
+    {
+      struct inode *next_dir;
+
+      result = get_next_part (next, &path);
+      if (result == 0)
+        break;
+      next_dir = result > 0 ? lookup (dir, name) : NULL;
+      inode_close (dir);
+      dir = next_dir;
+      if (dir != NULL && !inode_is_dir (dir))
+        {
+          inode_close (dir);
+          dir = NULL;
+        }
+      else if (dir != NULL)
+        strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    {
+      inode_close (dir);
+      dir = NULL;
+    }
+  return dir;
+}
+
+/* Opens the directory that should contain the file named by
+   PATH, and stores the last name in PATH in NAME.  Returns the
+   directory, or a null pointer on failure. */
+static struct dir *
+open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  return dir_open (resolve (path, name));
+}
+
+/* Opens and returns the inode of the file named by PATH, or a
+   null pointer if there is no such file. */
+static struct inode *
+open_path (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct inode *dir = resolve (path, name);
+  struct inode *inode = dir != NULL ? lookup (dir, name) : NULL;
+
+  inode_close (dir);
+  return inode;
+}
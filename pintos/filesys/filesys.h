@@ -8,6 +8,10 @@
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
+/* Reserved region of the file system device for the journal. */
+#define JOURNAL_SECTOR 2        /* First journal sector. */
+#define JOURNAL_CNT 128         /* Number of journal sectors. */
+
 /* Block device that contains the file system. */
 struct block *fs_device;
 
@@ -16,5 +20,7 @@ void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_mkdir (const char *name);
+bool filesys_chdir (const char *name);
 
 #endif /* filesys/filesys.h */
@@ -4,19 +4,46 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* A sector freed by a transaction that has not committed yet
+   is not reused, because if the system stopped before the
+   transaction committed, the sector would still belong to its
+   old owner, which writes to it as file data would corrupt.
+   Such sectors are marked free in free_map, which is what the
+   free map file records, but are left marked in used_map, from
+   which sectors are allocated, until the transaction freeing
+   them, released_seq, has committed.  Until then, an allocation
+   can fail for lack of space even though the sectors are free. */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *used_map;      /* Sectors not free for reuse. */
+static struct bitmap *released;      /* Freed, not reusable yet. */
+static size_t released_cnt;          /* Number of bits in RELEASED. */
+static uint32_t released_seq;        /* Transaction that freed them. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+static bool write_bits (block_sector_t, size_t cnt);
+static void reclaim (void);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  used_map = bitmap_create (block_size (fs_device));
+  released = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || used_map == NULL || released == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_CNT, true);
+  bitmap_mark (used_map, FREE_MAP_SECTOR);
+  bitmap_mark (used_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (used_map, JOURNAL_SECTOR, JOURNAL_CNT, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,26 +54,141 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  reclaim ();
+  sector = bitmap_scan_from_hint (used_map, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
+      bitmap_set_multiple (used_map, sector, cnt, true);
+      bitmap_set_multiple (free_map, sector, cnt, true);
+    }
+  if (sector != BITMAP_ERROR && !write_bits (sector, cnt))
+    {
+      bitmap_set_multiple (used_map, sector, cnt, false);
+      bitmap_set_multiple (free_map, sector, cnt, false);
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates an extent of up to CNT consecutive sectors, which
+   should be positive, and stores the first into *SECTORP.
+   Prefers to start the extent at GOAL, so that a file that grows
+   stays contiguous; failing that, takes the next run of CNT free
+   sectors; failing that, takes as many sectors as are free
+   together at the next free sector.
+   Returns the number of sectors allocated, which is 0 if the
+   disk is full or the free_map file could not be written. */
+size_t
+free_map_allocate_extent (block_sector_t goal, size_t cnt,
+                          block_sector_t *sectorp)
+{
+  size_t start, end;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  reclaim ();
+  if (goal < bitmap_size (used_map) && !bitmap_test (used_map, goal))
+    start = goal;
+  else 
+    {
+      start = bitmap_scan_from_hint (used_map, cnt, false);
+      if (start == BITMAP_ERROR)
+        start = bitmap_scan_from_hint (used_map, 1, false);
+      if (start == BITMAP_ERROR)
+        {
+          lock_release (&free_map_lock);
+          return 0;
+        }
+    }
+
+  /* Extend the extent up to the next allocated sector. */
+  end = bitmap_scan (used_map, start, 1, true);
+  if (end == BITMAP_ERROR)
+    end = bitmap_size (used_map);
+  if (end - start > cnt)
+    end = start + cnt;
+
+  bitmap_set_multiple (used_map, start, end - start, true);
+  bitmap_set_multiple (free_map, start, end - start, true);
+  if (!write_bits (start, end - start)) 
+    {
+      bitmap_set_multiple (used_map, start, end - start, false);
+      bitmap_set_multiple (free_map, start, end - start, false);
+      end = start;
+    }
+  lock_release (&free_map_lock);
+  if (end > start)
+    *sectorp = start;
+  return end - start;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the transaction that frees them has committed. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_bits (sector, cnt);
+  if (free_map_file == NULL)
+    bitmap_set_multiple (used_map, sector, cnt, false);
+  else 
+    {
+      /* Any sectors released by an earlier transaction are
+         reusable now, because it has committed. */
+      uint32_t seq = journal_txn ();
+      reclaim ();
+      bitmap_set_multiple (released, sector, cnt, true);
+      released_cnt += cnt;
+      released_seq = seq;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Makes the sectors in RELEASED reusable if the transaction that
+   freed them has committed.  free_map_lock must be held. */
+static void
+reclaim (void) 
+{
+  size_t start = 0;
+
+  if (released_cnt == 0 || !journal_is_committed (released_seq))
+    return;
+  while (released_cnt > 0) 
+    {
+      size_t end;
+
+      start = bitmap_scan (released, start, 1, true);
+      ASSERT (start != BITMAP_ERROR);
+      end = bitmap_scan (released, start, 1, false);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (released);
+      bitmap_set_multiple (released, start, end - start, false);
+      bitmap_set_multiple (used_map, start, end - start, false);
+      released_cnt -= end - start;
+      start = end;
+    }
+}
+
+/* Writes the part of the free map that records the state of the
+   CNT sectors starting at SECTOR to the free map file, if it is
+   open.  Returns true if successful, false otherwise.
+   free_map_lock must be held.  Writing the free map file never
+   allocates sectors, because they were all allocated when it was
+   created, so this does not recurse into the free map. */
+static bool
+write_bits (block_sector_t sector, size_t cnt) 
+{
+  return (free_map_file == NULL
+          || bitmap_write_part (free_map, free_map_file, sector, cnt));
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,7 +198,8 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, free_map_file)
+      || !bitmap_read (used_map, free_map_file))
     PANIC ("can't read free map");
 }
 
@@ -72,14 +215,21 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file starts out as a hole, so
+     writing it allocates its sectors.  free_map_file is still
+     unset, so they are recorded only in the bitmap; the disk is
+     empty, so they all come from one extent, allocated before
+     any of the bitmap is copied to them. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  free_map_file = file;
 }
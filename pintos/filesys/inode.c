@@ -1,76 +1,124 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
-#include "threads/malloc.h"
+#include "filesys/journal.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A file's data sectors are found through a multi-level index.
+   The on-disk inode holds DIRECT_CNT pointers to data sectors,
+   then a pointer to an indirect block, a sector full of pointers
+   to data sectors, and then a pointer to a doubly indirect
+   block, a sector full of pointers to indirect blocks.
+
+   A pointer of 0 marks a "hole" whose data reads as zeros:
+   sector 0 holds the free map's inode, so it is never a data or
+   index sector.  Sectors are allocated for holes when data is
+   first written to them, and zeroed then, in the cache only.  A
+   new file's initial length is all holes, so creating a file
+   writes only its inode, however long it is, and reading the
+   part never written needs no disk access. */
+#define DIRECT_CNT 122
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define INODE_PTR_CNT (DIRECT_CNT + 2)
+
+/* Maximum number of data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t sectors[INODE_PTR_CNT]; /* Sector pointers. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* 1 if a directory, else 0. */
+    block_sector_t scratch;             /* Scratch inode, or 0. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
-
-/* In-memory inode. */
+/* In-memory inode.
+   The on-disk inode is not copied here: its sector pointers are
+   read and written through the buffer cache on each access, and
+   its sector is evicted from the cache like any other, so an
+   access may have to read it from disk again.  Only the fields
+   needed on every access are kept.
+
+   LOCK serializes writes to the inode, which may allocate
+   sectors and extend it.  Reads do not take it: sector pointers
+   are read atomically from the cache, and LENGTH is only
+   increased after the data up to it has been written, so a
+   reader never sees unwritten data past the old end of file.
+   DIR_LOCK is for the directory code, to protect the entries
+   of a directory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    struct lock lock;                   /* Protects the members below. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    off_t length;                       /* File size in bytes. */
+    bool is_dir;                        /* Is this a directory? */
+    bool is_scratch;                    /* Written like file data? */
+    struct rwlock dir_lock;             /* Protects directory entries. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
-{
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
-}
-
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+static block_sector_t byte_to_sector (struct inode *, off_t pos);
+static block_sector_t write_sector (struct inode *, off_t offset,
+                                    off_t size);
+static void release_sectors (block_sector_t inode_sector);
+static bool is_metadata (const struct inode *);
+static void set_scratch (struct inode *, block_sector_t);
+static void release_scratch (struct inode *);
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+
+/* Open inodes, hashed on sector, so that opening a single inode
+   twice returns the same `struct inode'.  open_inodes_lock
+   protects the table and the open_cnt and removed members of
+   the inodes in it. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Caches for in-memory inodes and for on-disk inodes under
+   construction. */
+static struct kmem_cache *inode_cache;
+static struct kmem_cache *sector_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+  sector_cache = kmem_cache_create ("sector", BLOCK_SECTOR_SIZE, NULL);
+  if (inode_cache == NULL || sector_cache == NULL
+      || !hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("inode_init: out of memory");
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, all zeros,
+   and writes the new inode to sector SECTOR on the file system
+   device.  The inode is marked as a directory if IS_DIR is
+   true.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is too
+   large.  No data sectors are allocated: the data is a hole. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,63 +129,86 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
-  disk_inode = calloc (1, sizeof *disk_inode);
+  if ((size_t) DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE) > MAX_SECTORS)
+    return false;
+
+  disk_inode = kmem_cache_alloc (sector_cache);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      memset (disk_inode, 0, sizeof *disk_inode);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      disk_inode->is_dir = is_dir;
+      journal_write_at (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
+      kmem_cache_free (sector_cache, disk_inode);
     }
   return success;
 }
 
+/* Returns the open inode for SECTOR with its open count
+   incremented, or a null pointer if SECTOR is not open.  The
+   caller must hold open_inodes_lock. */
+static struct inode *
+find_open (block_sector_t sector) 
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e == NULL)
+    return NULL;
+  hash_entry (e, struct inode, elem)->open_cnt++;
+  return hash_entry (e, struct inode, elem);
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *other;
+  uint32_t is_dir;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  lock_acquire (&open_inodes_lock);
+  inode = find_open (sector);
+  lock_release (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, reading the disk without holding the lock. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->is_scratch = false;
+  lock_init (&inode->lock);
+  rwlock_init (&inode->dir_lock, RWLOCK_PREFER_WRITERS);
+  cache_read_at (sector, &inode->length,
+                 offsetof (struct inode_disk, length), sizeof inode->length);
+  cache_read_at (sector, &is_dir, offsetof (struct inode_disk, is_dir),
+                 sizeof is_dir);
+  inode->is_dir = is_dir != 0;
+
+  /* Another thread may have opened the inode meanwhile. */
+  lock_acquire (&open_inodes_lock);
+  other = find_open (sector);
+  if (other == NULL)
+    hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+  if (other != NULL)
+    {
+      kmem_cache_free (inode_cache, inode);
+      return other;
+    }
   return inode;
 }
 
@@ -146,7 +217,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,25 +238,33 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Once the last opener takes INODE out of the table, nobody
+     else can reach it, so the rest needs no lock. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          journal_begin ();
+          release_sectors (inode->sector);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          journal_end ();
         }
 
-      free (inode); 
+      kmem_cache_free (inode_cache, inode);
     }
 }
 
@@ -191,7 +274,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,7 +287,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -220,59 +304,68 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
-
   return bytes_read;
 }
 
+/* Queues the sectors that hold the SIZE bytes of INODE starting
+   at OFFSET to be read into the buffer cache in the background.
+   Holes and sectors past the end of INODE are ignored. */
+void
+inode_readahead (struct inode *inode, off_t size, off_t offset) 
+{
+  off_t end = offset + size;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE) 
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != 0)
+        cache_readahead (sector);
+    }
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full, the maximum file size is
+   reached, or an error occurs.  A write past end of file extends
+   the inode, and any gap between the old end of file and OFFSET
+   becomes a hole. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  lock_acquire (&inode->lock);
+  if (inode->deny_write_cnt) 
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left before the maximum file size, bytes left in
+         sector, lesser of the two. */
+      off_t inode_left = (off_t) MAX_SECTORS * BLOCK_SECTOR_SIZE - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,39 +374,41 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
+      /* Each sector is written in an operation of its own, along
+         with the length if it grows, so that a long write cannot
+         overflow the running transaction.  Nested in a larger
+         operation, the sectors are part of that one instead.
+         Beginning one may wait with INODE's lock held, but an
+         operation in progress never waits for that lock: writers
+         of a file take it before they begin. */
+      journal_begin ();
+      sector_idx = write_sector (inode, offset, size);
+      if (sector_idx != 0) 
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          if (is_metadata (inode))
+            journal_write_at (sector_idx, buffer + bytes_written,
+                              sector_ofs, chunk_size);
+          else
+            cache_write_at (sector_idx, buffer + bytes_written,
+                            sector_ofs, chunk_size);
+          if (offset + chunk_size > inode->length) 
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              inode->length = offset + chunk_size;
+              journal_write_at (inode->sector, &inode->length,
+                                offsetof (struct inode_disk, length),
+                                sizeof inode->length);
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
         }
+      journal_end ();
+      if (sector_idx == 0)
+        break;
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
-
+  lock_release (&inode->lock);
   return bytes_written;
 }
 
@@ -322,8 +417,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +429,450 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Returns true if INODE is a directory, false otherwise. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->is_dir;
+}
+
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  return inode->open_cnt;
+}
+
+/* Acquires the lock on the entries of directory INODE, for
+   writing if WRITE is true, otherwise for reading. */
+void
+inode_lock_dir (struct inode *inode, bool write)
+{
+  ASSERT (inode->is_dir);
+  if (write)
+    rwlock_acquire_write (&inode->dir_lock);
+  else
+    rwlock_acquire_read (&inode->dir_lock);
+}
+
+/* Releases the lock on the entries of directory INODE, whichever
+   way the current thread holds it. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  if (rwlock_held_by_current_thread (&inode->dir_lock))
+    rwlock_release_write (&inode->dir_lock);
+  else
+    rwlock_release_read (&inode->dir_lock);
+}
+
+/* Creates a "scratch" inode for INODE, of the same kind, with
+   LENGTH bytes of zeros, and returns it open, or returns a null
+   pointer if the disk is full or memory is short.  The caller can
+   build new data for INODE in the scratch inode and then swap the
+   two inodes' data with inode_swap_scratch(), or give up with
+   inode_drop_scratch().  Until then, the scratch inode belongs to
+   INODE on disk, so if the system stops in the meantime it is
+   released when INODE is deleted or gets its next scratch inode.
+   INODE can have only one scratch inode at a time; the caller
+   must see to that. */
+struct inode *
+inode_create_scratch (struct inode *inode, off_t length) 
+{
+  struct inode *scratch = NULL;
+  block_sector_t sector;
+
+  journal_begin ();
+  release_scratch (inode);
+  if (free_map_allocate (1, &sector)) 
+    {
+      if (inode_create (sector, length, inode->is_dir)) 
+        {
+          set_scratch (inode, sector);
+          scratch = inode_open (sector);
+          if (scratch != NULL)
+            scratch->is_scratch = true;
+          else
+            release_scratch (inode);
+        }
+      else
+        free_map_release (sector, 1);
+    }
+  journal_end ();
+  return scratch;
+}
+
+/* Gives INODE the data of SCRATCH, obtained from
+   inode_create_scratch() for it, in a single transaction, and
+   releases SCRATCH with INODE's old data.  Returns false, leaving
+   both unchanged, if memory is short. */
+bool
+inode_swap_scratch (struct inode *inode, struct inode *scratch) 
+{
+  struct inode_disk *a = kmem_cache_alloc (sector_cache);
+  struct inode_disk *b = kmem_cache_alloc (sector_cache);
+  block_sector_t ptrs[INODE_PTR_CNT];
+  block_sector_t sectors[2];
+  void *buffers[2];
+
+  if (a == NULL || b == NULL) 
+    {
+      kmem_cache_free (sector_cache, a);
+      kmem_cache_free (sector_cache, b);
+      return false;
+    }
+
+  /* SCRATCH's data was written like file data, and not all of it
+     was necessarily made to reach the disk before a commit, so
+     write it back now, before the swap can commit. */
+  cache_flush ();
+
+  lock_acquire (&inode->lock);
+  cache_read (inode->sector, a);
+  cache_read (scratch->sector, b);
+  memcpy (ptrs, a->sectors, sizeof ptrs);
+  memcpy (a->sectors, b->sectors, sizeof ptrs);
+  memcpy (b->sectors, ptrs, sizeof ptrs);
+  a->length = scratch->length;
+  b->length = inode->length;
+  sectors[0] = inode->sector;
+  sectors[1] = scratch->sector;
+  buffers[0] = a;
+  buffers[1] = b;
+  journal_write_sectors (2, sectors, buffers);
+  inode->length = a->length;
+  scratch->length = b->length;
+  lock_release (&inode->lock);
+
+  kmem_cache_free (sector_cache, a);
+  kmem_cache_free (sector_cache, b);
+  inode_drop_scratch (inode, scratch);
+  return true;
+}
+
+/* Closes SCRATCH, obtained from inode_create_scratch() for
+   INODE, and releases it along with its data. */
+void
+inode_drop_scratch (struct inode *inode, struct inode *scratch) 
+{
+  /* Take SCRATCH out of the open inodes before its sector can be
+     reused. */
+  inode_close (scratch);
+
+  journal_begin ();
+  release_scratch (inode);
+  journal_end ();
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  return inode->length;
+}
+
+/* Returns true if INODE's data is file system metadata, whose
+   writes are journaled: that is, if INODE is a directory or the
+   free map.  A scratch inode's data is not visible until it is
+   swapped in, so it is written like file data, which keeps a
+   large one from overflowing the running transaction. */
+static bool
+is_metadata (const struct inode *inode) 
+{
+  return ((inode->is_dir && !inode->is_scratch)
+          || inode->sector == FREE_MAP_SECTOR);
+}
+
+/* A sector of zeros. */
+static const char zeros[BLOCK_SECTOR_SIZE];
+
+/* The sector pointers of an inode are named by the index block
+   that holds them and their slot within it.  Index block 0
+   stands for the sectors[] array of the inode itself. */
+
+/* Returns the pointer in slot SLOT of INODE's index block
+   INDEX. */
+static block_sector_t
+get_ptr (const struct inode *inode, block_sector_t index, size_t slot) 
+{
+  block_sector_t ptr;
+
+  cache_read_at (index != 0 ? index : inode->sector, &ptr,
+                 slot * sizeof ptr, sizeof ptr);
+  return ptr;
+}
+
+/* Sets the pointer in slot SLOT of INODE's index block INDEX to
+   PTR. */
+static void
+set_ptr (struct inode *inode, block_sector_t index, size_t slot,
+         block_sector_t ptr) 
+{
+  journal_write_at (index != 0 ? index : inode->sector, &ptr,
+                    slot * sizeof ptr, sizeof ptr);
+}
+
+/* Returns the index block that slot SLOT of INODE's index block
+   INDEX points to.  If there is none and ALLOCATE is true,
+   allocates one filled with zeros.  Returns 0 if there is no
+   such index block. */
+static block_sector_t
+get_index (struct inode *inode, block_sector_t index, size_t slot,
+           bool allocate) 
+{
+  block_sector_t ptr = get_ptr (inode, index, slot);
+
+  if (ptr == 0 && allocate && free_map_allocate (1, &ptr)) 
+    {
+      journal_write_at (ptr, zeros, 0, BLOCK_SECTOR_SIZE);
+      set_ptr (inode, index, slot, ptr);
+    }
+  return ptr;
+}
+
+/* Finds the pointer to data sector IDX of INODE and stores its
+   index block in *INDEX and its slot in *SLOT.  If an index block
+   on the way is missing and ALLOCATE is true, allocates it.
+   Returns false if an index block is missing, either because
+   ALLOCATE is false or because the disk is full, or if IDX is
+   beyond the maximum file size. */
+static bool
+locate_ptr (struct inode *inode, size_t idx, bool allocate,
+            block_sector_t *index, size_t *slot) 
+{
+  if (idx < DIRECT_CNT) 
+    {
+      *index = 0;
+      *slot = idx;
+      return true;
+    }
+
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR) 
+    {
+      *index = get_index (inode, 0, INDIRECT_IDX, allocate);
+      *slot = idx;
+      return *index != 0;
+    }
+
+  idx -= PTRS_PER_SECTOR;
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR) 
+    {
+      block_sector_t dbl = get_index (inode, 0, DBL_INDIRECT_IDX, allocate);
+      if (dbl == 0)
+        return false;
+      *index = get_index (inode, dbl, idx / PTRS_PER_SECTOR, allocate);
+      *slot = idx % PTRS_PER_SECTOR;
+      return *index != 0;
+    }
+
+  return false;
+}
+
+/* Returns the pointer to data sector IDX of INODE, which is 0
+   for a hole or beyond the maximum file size. */
+static block_sector_t
+get_data_ptr (struct inode *inode, size_t idx) 
+{
+  block_sector_t index;
+  size_t slot;
+
+  if (!locate_ptr (inode, idx, false, &index, &slot))
+    return 0;
+  return get_ptr (inode, index, slot);
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, or 0 if that byte is in a hole or beyond the
+   maximum file size. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos) 
+{
+  ASSERT (inode != NULL);
+  ASSERT (pos >= 0);
+
+  return get_data_ptr (inode, pos / BLOCK_SECTOR_SIZE);
+}
+
+/* Allocates sectors for data sector IDX of INODE, which is a
+   hole whose pointer is in slot SLOT of index block INDEX, along
+   with as many of the holes that immediately follow it before
+   data sector END_IDX and in the same index block as possible.
+   They come from a single extent of contiguous sectors placed
+   right after the file's preceding sector if there is room.
+   Stores the first sector in *SECTORP and returns the number
+   allocated, which is 0 if the disk is full.  Does not set the
+   pointers. */
+static size_t
+allocate_extent (struct inode *inode, size_t idx, size_t end_idx,
+                 block_sector_t index, size_t slot, block_sector_t *sectorp) 
+{
+  size_t limit = index == 0 ? DIRECT_CNT : PTRS_PER_SECTOR;
+  block_sector_t goal;
+  size_t cnt, got;
+
+  /* Count the holes to fill. */
+  for (cnt = 1; idx + cnt < end_idx; cnt++) 
+    if (slot + cnt >= limit || get_ptr (inode, index, slot + cnt) != 0)
+      break;
+
+  /* Try to continue the extent that holds the preceding data. */
+  goal = idx > 0 ? get_data_ptr (inode, idx - 1) : 0;
+  goal = goal != 0 ? goal + 1 : inode->sector + 1;
+
+  got = free_map_allocate_extent (goal, cnt, sectorp);
+  if (got > 0 && !is_metadata (inode))
+    journal_revoke (*sectorp, got);
+  return got;
+}
+
+/* Returns the data sector of INODE that holds byte offset
+   OFFSET, which a write of the SIZE bytes starting there is
+   about to modify.  If the sector is in a hole, fills it, along
+   with as many of the holes that follow it within the write as
+   possible, from a single extent.  Sectors newly allocated are
+   filled with zeros before they are made part of the file; for
+   file data, all of them are, and the transaction that does so
+   will not commit until they are written back, so that a crash
+   cannot expose their old contents.  Metadata sectors are only
+   zeroed if the write will not completely overwrite them.
+   Returns 0 if the disk is full. */
+static block_sector_t
+write_sector (struct inode *inode, off_t offset, off_t size) 
+{
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t end_idx = DIV_ROUND_UP (offset + size, BLOCK_SECTOR_SIZE);
+  block_sector_t index, ptr, sector;
+  size_t slot, got, i;
+
+  if (!locate_ptr (inode, idx, true, &index, &slot))
+    return 0;
+  ptr = get_ptr (inode, index, slot);
+  if (ptr != 0)
+    return ptr;
+
+  got = allocate_extent (inode, idx, end_idx, index, slot, &sector);
+  if (got == 0)
+    return 0;
+
+  for (i = 0; i < got; i++) 
+    {
+      off_t sector_start = (off_t) (idx + i) * BLOCK_SECTOR_SIZE;
+      if (!is_metadata (inode)) 
+        {
+          cache_write (sector + i, zeros);
+          journal_order_data (sector + i);
+        }
+      else if (sector_start < offset
+               || sector_start + BLOCK_SECTOR_SIZE > offset + size)
+        journal_write_at (sector + i, zeros, 0, BLOCK_SECTOR_SIZE);
+      set_ptr (inode, index, slot + i, sector + i);
+    }
+  return sector;
+}
+
+/* Releases index block INDEX, which is LEVEL levels above the
+   data sectors, along with every sector it points to. */
+static void
+release_index (block_sector_t index, int level) 
+{
+  block_sector_t *ptrs = kmem_cache_alloc (sector_cache);
+  size_t i;
+
+  if (ptrs == NULL)
+    PANIC ("release_index: out of memory");
+  cache_read (index, ptrs);
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    if (ptrs[i] != 0) 
+      {
+        if (level > 1)
+          release_index (ptrs[i], level - 1);
+        else
+          free_map_release (ptrs[i] , 1);
+      }
+  kmem_cache_free (sector_cache, ptrs);
+  free_map_release (index, 1);
+}
+
+/* Records SCRATCH as INODE's scratch inode. */
+static void
+set_scratch (struct inode *inode, block_sector_t scratch) 
+{
+  journal_write_at (inode->sector, &scratch,
+                    offsetof (struct inode_disk, scratch), sizeof scratch);
+}
+
+/* Releases INODE's scratch inode, if it has one, and all of its
+   sectors.  INODE stops pointing to it first, so that if the
+   system stops before all of this is on disk, the worst that can
+   happen is that some sectors are never released. */
+static void
+release_scratch (struct inode *inode) 
+{
+  block_sector_t scratch;
+
+  cache_read_at (inode->sector, &scratch,
+                 offsetof (struct inode_disk, scratch), sizeof scratch);
+  if (scratch != 0) 
+    {
+      set_scratch (inode, 0);
+      release_sectors (scratch);
+      free_map_release (scratch, 1);
+    }
+}
+
+/* Releases all the data and index sectors of the inode in
+   INODE_SECTOR, and its scratch inode if it has one. */
+static void
+release_sectors (block_sector_t inode_sector) 
+{
+  struct inode_disk *d = kmem_cache_alloc (sector_cache);
+  size_t i;
+
+  if (d == NULL)
+    PANIC ("release_sectors: out of memory");
+  cache_read (inode_sector, d);
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (d->sectors[i] != 0)
+      free_map_release (d->sectors[i] , 1);
+  if (d->sectors[INDIRECT_IDX] != 0)
+    release_index (d->sectors[INDIRECT_IDX], 1);
+  if (d->sectors[DBL_INDIRECT_IDX] != 0)
+    release_index (d->sectors[DBL_INDIRECT_IDX], 2);
+  if (d->scratch != 0) 
+    {
+      release_sectors (d->scratch);
+      free_map_release (d->scratch, 1);
+    }
+  kmem_cache_free (sector_cache, d);
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
 }
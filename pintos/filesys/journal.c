@@ -0,0 +1,661 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/lockstat.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Inode sectors, index blocks, directory data and the free map
+   are metadata.  Every write to a metadata sector goes through
+   journal_write_at(), which adds the sector to the running
+   transaction and marks it logged in the buffer cache, so that
+   it does not reach its place on disk yet.  Operations that must
+   be atomic, such as creating a file, are bracketed by
+   journal_begin() and journal_end().  Many operations are
+   grouped into a single transaction, which is committed when no
+   operation is in progress and either it has grown large or the
+   commit thread asks for it, every COMMIT_INTERVAL ticks.
+
+   A transaction is only ever committed between operations.  Each
+   operation may add up to OP_SECTORS sectors and OP_REVOKES
+   revoked ranges (see below) to the running transaction, and
+   journal_begin() waits until the transaction has room for that
+   on top of the operations already in progress.  It also waits
+   while a commit is due, so that the operations in progress
+   drain and the last of them commits.  Only an operation that
+   exceeds its budget by itself can fill the transaction, in
+   which case it is committed in the middle of that operation
+   rather than overflow.  An operation that would exceed its
+   budget should be split into steps that each leave the file
+   system consistent, as inode_write_at() does for each sector.
+
+   The journal occupies JOURNAL_CNT sectors starting at
+   JOURNAL_SECTOR.  The first is a superblock that says where the
+   oldest transaction not yet known to be on disk starts; the
+   rest form the log.  Committing writes, one after another at the
+   head of the log, a descriptor sector listing the transaction's
+   sectors, a copy of each of them, and a commit record.  The
+   descriptor and the copies are adjacent, so they go to the disk
+   in a single transfer.  Only then are the sectors unlogged and
+   allowed to be written back in place.
+
+   When the log is nearly full, a checkpoint writes every dirty
+   sector in the cache back in place and empties the log.  When
+   the file system is mounted, filesys_init() calls
+   journal_init(), which replays each complete transaction in the
+   log, in order, by copying its sectors to their places; an
+   incomplete transaction, one without a commit record, is
+   ignored, so each operation is either entirely on disk or not
+   at all.
+
+   File data is not journaled, but a transaction that makes a file
+   point to a data sector must not reach the disk before the
+   data does, or after a crash the file would show whatever the
+   sector held before, perhaps another file's data.
+   journal_order_data() adds such a sector to the running
+   transaction's list of data sectors, which are written back
+   from the cache before it commits.  If the list fills up, every
+   dirty sector in the cache is written back instead.
+
+   A sector that was metadata and is reused for file data must
+   not be overwritten by a replay of its old contents.  Before
+   such a sector is written, journal_revoke() records in the
+   running transaction that the copies of it in the log are
+   revoked, and replay skips the copies of a sector that a later
+   transaction revoked.  The free map does not reuse a sector
+   until the transaction that freed it has committed (see
+   journal_txn()), so a sector in the running transaction is
+   never reused. */
+
+/* Magic numbers. */
+#define SUPER_MAGIC 0x4a524e4c          /* Superblock. */
+#define DESC_MAGIC 0x4a445343           /* Descriptor. */
+#define COMMIT_MAGIC 0x4a434d54         /* Commit record. */
+
+/* The log. */
+#define LOG_START (JOURNAL_SECTOR + 1)
+#define LOG_END (JOURNAL_SECTOR + JOURNAL_CNT)
+
+/* A transaction is committed at the end of an operation once it
+   has TXN_SOFT_MAX sectors, and in the middle of one, giving up
+   that operation's atomicity, if it reaches TXN_MAX.  Logged
+   sectors cannot be evicted from the cache, so TXN_MAX must
+   leave plenty of the cache for everything else. */
+#define TXN_SOFT_MAX 32
+#define TXN_MAX 48
+
+/* Most ranges of sectors a transaction can revoke. */
+#define TXN_REVOKE_MAX 32
+
+/* Budget of each operation, in sectors and revoked ranges. */
+#define OP_SECTORS 12
+#define OP_REVOKES 2
+
+/* Most data sectors listed for writing back before a commit.  If
+   a transaction has more, the whole cache is written back. */
+#define TXN_DATA_MAX 128
+
+/* Most revoked ranges in the log.  A checkpoint is taken before
+   there can be more. */
+#define LOG_REVOKE_MAX 128
+
+/* How often, in timer ticks, to commit. */
+#define COMMIT_INTERVAL (5 * TIMER_FREQ)
+
+/* Journal superblock.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_super
+  {
+    unsigned magic;                     /* SUPER_MAGIC. */
+    block_sector_t start;               /* First transaction in log. */
+    uint32_t seq;                       /* Its sequence number. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12];
+  };
+
+/* A range of sectors whose copies in earlier transactions are
+   not to be replayed. */
+struct revoke
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
+
+/* Transaction descriptor or commit record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_record
+  {
+    unsigned magic;                     /* DESC_MAGIC or COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    uint32_t revoke_cnt;                /* Number of revoked ranges. */
+    block_sector_t sectors[TXN_MAX];    /* Where the sectors belong. */
+    struct revoke revokes[TXN_REVOKE_MAX]; /* Revoked ranges. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16
+                   - TXN_MAX * sizeof (block_sector_t)
+                   - TXN_REVOKE_MAX * sizeof (struct revoke)];
+  };
+
+/* Protects all the state below. */
+static struct lock journal_lock;
+
+/* Running transaction. */
+static block_sector_t txn_sectors[TXN_MAX];
+static size_t txn_cnt;
+static struct revoke txn_revokes[TXN_REVOKE_MAX];
+static size_t txn_revoke_cnt;
+static block_sector_t txn_data[TXN_DATA_MAX]; /* Data sectors. */
+static size_t txn_data_cnt;
+static bool txn_data_all;               /* Write back all data? */
+static int active_cnt;                  /* Operations in progress. */
+static bool commit_wanted;              /* Commit when none are? */
+static struct condition room_cond;      /* Signaled when one may begin. */
+
+/* Log state. */
+static block_sector_t log_head;         /* Where the next goes. */
+static uint32_t next_seq;               /* Its sequence number. */
+
+/* Sectors with copies in the log, and the number of revoked
+   ranges in it. */
+static block_sector_t log_sectors[JOURNAL_CNT];
+static size_t log_sector_cnt;
+static size_t log_revoke_cnt;
+
+/* Revoked ranges in the log, and the transactions that revoked
+   them, gathered for replay. */
+static struct revoke log_revokes[LOG_REVOKE_MAX];
+static uint32_t log_revoke_seqs[LOG_REVOKE_MAX];
+
+/* Buffers for building and reading the journal. */
+static struct journal_super super;
+static struct journal_record record;
+static uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+/* Room for a descriptor and the copies of TXN_MAX sectors. */
+#define LOG_BUFFER_SIZE ((TXN_MAX + 1) * BLOCK_SECTOR_SIZE)
+static uint8_t *log_buffer;
+
+/* Statistics. */
+static unsigned long long commit_cnt, logged_cnt, checkpoint_cnt;
+static unsigned long long replay_cnt;
+
+static bool has_room (void);
+static bool in_txn (block_sector_t);
+static void create (void);
+static void replay (void);
+static void commit (void);
+static void checkpoint (void);
+static thread_func committer;
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   journal; otherwise, replays the transactions in the existing
+   one. */
+void
+journal_init (bool format) 
+{
+  ASSERT (sizeof (struct journal_super) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_record) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&room_cond);
+  log_buffer = palloc_get_multiple (PAL_ASSERT,
+                                    DIV_ROUND_UP (LOG_BUFFER_SIZE, PGSIZE));
+  if (format)
+    create ();
+  else
+    replay ();
+  thread_create ("journal-commit", PRI_DEFAULT, committer, NULL, 0);
+}
+
+/* Commits the running transaction and empties the log, so that
+   the next mount has nothing to replay. */
+void
+journal_done (void) 
+{
+  lock_acquire (&journal_lock);
+  commit ();
+  checkpoint ();
+  lock_release (&journal_lock);
+}
+
+/* Begins an operation whose metadata writes must reach the disk
+   together or not at all.  Operations may nest; a nested one is
+   part of the outermost one.  Beginning an outermost operation
+   may have to wait for others to end, so the caller must not
+   hold any lock that an operation in progress might need. */
+void
+journal_begin (void) 
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (!has_room ()) 
+    {
+      if (active_cnt == 0)
+        commit ();
+      else
+        cond_wait (&room_cond, &journal_lock);
+    }
+  active_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation begun with journal_begin().  Commits the
+   running transaction if no other operation is in progress and a
+   commit is due. */
+void
+journal_end (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active_cnt > 0);
+  if (--active_cnt == 0 && (commit_wanted || txn_cnt >= TXN_SOFT_MAX))
+    commit ();
+  cond_broadcast (&room_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within
+   metadata sector SECTOR, as part of the running transaction.
+   If the transaction is full, which only an operation over its
+   budget can cause, commits it first. */
+void
+journal_write_at (block_sector_t sector, const void *buffer_,
+                  off_t ofs, off_t size) 
+{
+  lock_acquire (&journal_lock);
+  if (!in_txn (sector)) 
+    {
+      if (txn_cnt == TXN_MAX)
+        commit ();
+      txn_sectors[txn_cnt++] = sector;
+    }
+  cache_log_at (sector, buffer_, ofs, size);
+  lock_release (&journal_lock);
+}
+
+/* Writes each of the CNT whole metadata sectors SECTORS[i] from
+   BUFFERS[i], all in the same transaction, even if the running
+   transaction has to be committed first to make room. */
+void
+journal_write_sectors (size_t cnt, const block_sector_t sectors[],
+                       void *const buffers[]) 
+{
+  size_t new_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= TXN_MAX);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < cnt; i++)
+    if (!in_txn (sectors[i]))
+      new_cnt++;
+  if (txn_cnt + new_cnt > TXN_MAX)
+    commit ();
+  for (i = 0; i < cnt; i++) 
+    {
+      if (!in_txn (sectors[i]))
+        txn_sectors[txn_cnt++] = sectors[i];
+      cache_log_at (sectors[i], buffers[i], 0, BLOCK_SECTOR_SIZE);
+    }
+  lock_release (&journal_lock);
+}
+
+/* Makes the running transaction commit only once file data
+   sector SECTOR, which it is about to make part of a file, has
+   been written to disk from the cache.  The caller must have put
+   SECTOR's new contents, or zeros, in the cache. */
+void
+journal_order_data (block_sector_t sector) 
+{
+  lock_acquire (&journal_lock);
+  if (txn_data_cnt < TXN_DATA_MAX)
+    txn_data[txn_data_cnt++] = sector;
+  else
+    txn_data_all = true;
+  lock_release (&journal_lock);
+}
+
+/* Makes sure that replaying the journal will not overwrite the
+   CNT sectors starting at SECTOR, which have just been allocated
+   for file data.  If the log holds a copy of any of them, revokes
+   the range in the running transaction.  The range is merged
+   with the previous one if it directly follows it, since both
+   hold only file data now.  Only an operation that revokes more
+   than its budget can find the transaction full, in which case
+   it is committed first. */
+void
+journal_revoke (block_sector_t sector, size_t cnt) 
+{
+  struct revoke *last;
+  bool found = false;
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < txn_cnt; i++)
+    ASSERT (txn_sectors[i] < sector || txn_sectors[i] - sector >= cnt);
+  for (i = 0; i < log_sector_cnt; )
+    if (log_sectors[i] >= sector && log_sectors[i] - sector < cnt) 
+      {
+        log_sectors[i] = log_sectors[--log_sector_cnt];
+        found = true;
+      }
+    else
+      i++;
+
+  if (found) 
+    {
+      last = txn_revoke_cnt > 0 ? &txn_revokes[txn_revoke_cnt - 1] : NULL;
+      if (last != NULL && last->start + last->cnt == sector)
+        last->cnt += cnt;
+      else 
+        {
+          if (txn_revoke_cnt == TXN_REVOKE_MAX)
+            commit ();
+          txn_revokes[txn_revoke_cnt].start = sector;
+          txn_revokes[txn_revoke_cnt].cnt = cnt;
+          txn_revoke_cnt++;
+        }
+    }
+  lock_release (&journal_lock);
+}
+
+/* Returns the sequence number of the running transaction.  A
+   metadata write made before this call is part of that
+   transaction or an earlier one, so it is on disk once
+   journal_is_committed() returns true for the number. */
+uint32_t
+journal_txn (void) 
+{
+  uint32_t seq;
+
+  lock_acquire (&journal_lock);
+  seq = next_seq;
+  lock_release (&journal_lock);
+  return seq;
+}
+
+/* Returns true if transaction SEQ, obtained from journal_txn(),
+   has committed. */
+bool
+journal_is_committed (uint32_t seq) 
+{
+  bool committed;
+
+  lock_acquire (&journal_lock);
+  committed = seq < next_seq;
+  lock_release (&journal_lock);
+  return committed;
+}
+
+/* Commits the running transaction as soon as no operation is in
+   progress. */
+void
+journal_commit (void) 
+{
+  lock_acquire (&journal_lock);
+  if (active_cnt == 0)
+    commit ();
+  else
+    commit_wanted = true;
+  lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) 
+{
+  printf ("Journal: %llu commits of %llu sectors, %llu checkpoints, "
+          "%llu transactions replayed\n",
+          commit_cnt, logged_cnt, checkpoint_cnt, replay_cnt);
+  if (lockstat_enabled)
+    lock_stats_print (&journal_lock.stats, "Journal: journal_lock");
+}
+
+/* Returns true if an operation can begin now and stay within its
+   budget alongside those in progress, without a commit.
+   journal_lock must be held. */
+static bool
+has_room (void) 
+{
+  size_t op_cnt = active_cnt + 1;
+
+  return (!commit_wanted
+          && txn_cnt < TXN_SOFT_MAX
+          && txn_cnt + op_cnt * OP_SECTORS <= TXN_MAX
+          && txn_revoke_cnt + op_cnt * OP_REVOKES <= TXN_REVOKE_MAX);
+}
+
+/* Returns true if SECTOR is in the running transaction.
+   journal_lock must be held. */
+static bool
+in_txn (block_sector_t sector) 
+{
+  size_t i;
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector)
+      return true;
+  return false;
+}
+
+/* Writes the superblock, recording that the log is empty and
+   that the next transaction goes at its start. */
+static void
+write_super (void) 
+{
+  memset (&super, 0, sizeof super);
+  super.magic = SUPER_MAGIC;
+  super.start = LOG_START;
+  super.seq = next_seq;
+  block_write (fs_device, JOURNAL_SECTOR, &super);
+  log_head = LOG_START;
+  log_sector_cnt = 0;
+  log_revoke_cnt = 0;
+}
+
+/* Creates an empty journal.  Clears the whole log, so that
+   records left on the device by an earlier file system cannot be
+   taken for transactions. */
+static void
+create (void) 
+{
+  size_t per_write = LOG_BUFFER_SIZE / BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+
+  memset (log_buffer, 0, LOG_BUFFER_SIZE);
+  for (sector = LOG_START; sector < LOG_END; sector += per_write)
+    block_write_multiple (fs_device, sector,
+                          (LOG_END - sector < per_write
+                           ? LOG_END - sector : per_write), log_buffer);
+  next_seq = 1;
+  write_super ();
+}
+
+/* Reads the journal record in SECTOR into R and returns true if
+   it is a record of kind MAGIC for transaction SEQ with no more
+   than MAX_CNT sectors, false otherwise. */
+static bool
+read_record (block_sector_t sector, struct journal_record *r,
+             unsigned magic, uint32_t seq, size_t max_cnt) 
+{
+  block_read (fs_device, sector, r);
+  return (r->magic == magic && r->seq == seq && r->cnt <= max_cnt
+          && r->revoke_cnt <= TXN_REVOKE_MAX);
+}
+
+/* Returns true if one of the first CNT ranges in log_revokes
+   revokes the copy of SECTOR in transaction SEQ, that is, if it
+   includes SECTOR and was revoked by a later transaction. */
+static bool
+is_revoked (block_sector_t sector, uint32_t seq, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (log_revoke_seqs[i] > seq
+        && sector >= log_revokes[i].start
+        && sector - log_revokes[i].start < log_revokes[i].cnt)
+      return true;
+  return false;
+}
+
+/* Copies each complete transaction in the log to its place on
+   disk, then empties the log. */
+static void
+replay (void) 
+{
+  struct journal_record *c = (struct journal_record *) buffer;
+  size_t txn_total, revoke_total, t, i;
+  block_sector_t pos;
+
+  block_read (fs_device, JOURNAL_SECTOR, &super);
+  if (super.magic != SUPER_MAGIC)
+    PANIC ("journal_init: no journal found, reformat with -f");
+
+  /* Find the complete transactions, stopping at the first
+     incomplete one, and gather the ranges they revoke. */
+  pos = super.start;
+  revoke_total = 0;
+  for (txn_total = 0; pos + 2 <= LOG_END; txn_total++) 
+    {
+      uint32_t seq = super.seq + txn_total;
+      size_t max_cnt = LOG_END - pos - 2;
+      if (max_cnt > TXN_MAX)
+        max_cnt = TXN_MAX;
+
+      if (!read_record (pos, &record, DESC_MAGIC, seq, max_cnt)
+          || !read_record (pos + 1 + record.cnt, c, COMMIT_MAGIC, seq,
+                           record.cnt)
+          || c->cnt != record.cnt
+          || revoke_total + record.revoke_cnt > LOG_REVOKE_MAX)
+        break;
+      for (i = 0; i < record.revoke_cnt; i++) 
+        {
+          log_revokes[revoke_total] = record.revokes[i];
+          log_revoke_seqs[revoke_total++] = seq;
+        }
+      pos += record.cnt + 2;
+    }
+
+  /* Copy their sectors to their places, except those that a
+     later transaction revoked. */
+  pos = super.start;
+  for (t = 0; t < txn_total; t++) 
+    {
+      block_read (fs_device, pos, &record);
+      block_read_multiple (fs_device, pos + 1, record.cnt, log_buffer);
+      for (i = 0; i < record.cnt; i++) 
+        if (!is_revoked (record.sectors[i], record.seq, revoke_total))
+          block_write (fs_device, record.sectors[i],
+                       log_buffer + i * BLOCK_SECTOR_SIZE);
+      pos += record.cnt + 2;
+      replay_cnt++;
+    }
+  next_seq = super.seq + txn_total;
+  if (replay_cnt > 0)
+    printf ("journal: replayed %llu transactions\n", replay_cnt);
+  write_super ();
+}
+
+/* Writes the running transaction to the log, then lets its
+   sectors be written back in place.  journal_lock must be
+   held. */
+static void
+commit (void) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  /* Write the file data the transaction points to first. */
+  commit_wanted = false;
+  if (txn_data_all)
+    cache_flush ();
+  else
+    cache_flush_sectors (txn_data, txn_data_cnt);
+  txn_data_cnt = 0;
+  txn_data_all = false;
+  if (txn_cnt == 0 && txn_revoke_cnt == 0)
+    return;
+
+  /* Write descriptor, sectors, and commit record, in that
+     order. */
+  memset (&record, 0, sizeof record);
+  record.magic = DESC_MAGIC;
+  record.seq = next_seq;
+  record.cnt = txn_cnt;
+  record.revoke_cnt = txn_revoke_cnt;
+  memcpy (record.sectors, txn_sectors, txn_cnt * sizeof *txn_sectors);
+  memcpy (record.revokes, txn_revokes,
+          txn_revoke_cnt * sizeof *txn_revokes);
+  memcpy (log_buffer, &record, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < txn_cnt; i++) 
+    cache_read (txn_sectors[i], log_buffer + (i + 1) * BLOCK_SECTOR_SIZE);
+  block_write_multiple (fs_device, log_head, txn_cnt + 1, log_buffer);
+  record.magic = COMMIT_MAGIC;
+  block_write (fs_device, log_head + 1 + txn_cnt, &record);
+
+  /* The transaction is durable. */
+  for (i = 0; i < txn_cnt; i++) 
+    {
+      cache_unlog (txn_sectors[i]);
+      log_sectors[log_sector_cnt++] = txn_sectors[i];
+    }
+  log_head += txn_cnt + 2;
+  log_revoke_cnt += txn_revoke_cnt;
+  next_seq++;
+  commit_cnt++;
+  logged_cnt += txn_cnt;
+  txn_cnt = 0;
+  txn_revoke_cnt = 0;
+
+  /* Make sure the largest transaction fits next time. */
+  if (LOG_END - log_head < TXN_MAX + 2
+      || log_revoke_cnt + TXN_REVOKE_MAX > LOG_REVOKE_MAX)
+    checkpoint ();
+}
+
+/* Writes every committed sector back in place and empties the
+   log.  Must be called right after commit(), while no sector is
+   logged, because the log is the only up-to-date copy of a
+   committed sector that a later transaction has logged again.
+   journal_lock must be held. */
+static void
+checkpoint (void) 
+{
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (txn_cnt == 0);
+
+  cache_flush ();
+  write_super ();
+  checkpoint_cnt++;
+}
+
+/* Commit thread.  Commits the running transaction periodically,
+   so that metadata updates are durable after a bounded time. */
+static void
+committer (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      journal_commit ();
+    }
+}
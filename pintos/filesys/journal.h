@@ -0,0 +1,24 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_write_at (block_sector_t, const void *, off_t ofs, off_t size);
+void journal_write_sectors (size_t cnt, const block_sector_t sectors[],
+                            void *const buffers[]);
+void journal_order_data (block_sector_t);
+void journal_revoke (block_sector_t, size_t cnt);
+uint32_t journal_txn (void);
+bool journal_is_committed (uint32_t seq);
+void journal_commit (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
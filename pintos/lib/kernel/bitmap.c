@@ -27,6 +27,7 @@ typedef unsigned long elem_type;
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t hint;        /* Where bitmap_scan_from_hint() starts. */
     elem_type *bits;    /* Elements that represent bits. */
   };
 
@@ -69,6 +70,67 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a bit mask in which the bits of the element containing
+   bit START that represent bits START through END, exclusive,
+   are set to 1 and the rest are set to 0.  END must be greater
+   than START and no greater than the index of the first bit of
+   the next element. */
+static inline elem_type
+range_mask (size_t start, size_t end) 
+{
+  elem_type high = (end % ELEM_BITS
+                    ? ((elem_type) 1 << (end % ELEM_BITS)) - 1
+                    : (elem_type) -1);
+  elem_type low = ((elem_type) 1 << (start % ELEM_BITS)) - 1;
+  return high & ~low;
+}
+
+/* Returns the element of B with index IDX, inverted if VALUE is
+   false, so that bits equal to VALUE read as 1. */
+static inline elem_type
+elem_for (const struct bitmap *b, size_t idx, bool value) 
+{
+  return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the number of bits set to 1 in E.  (The kernel is not
+   linked with libgcc, so __builtin_popcountl() is unavailable.) */
+static inline size_t
+count_ones (elem_type e) 
+{
+  size_t cnt = 0;
+  for (; e != 0; e &= e - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the index of the first bit at or after START in B
+   that is set to VALUE, or B's size if there is none.  Examines
+   B an element at a time. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) 
+{
+  size_t idx = elem_idx (start);
+  size_t last = elem_cnt (b->bit_cnt);
+  elem_type e;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  /* Ignore the bits before START in the first element. */
+  e = elem_for (b, idx, value) & ~(bit_mask (start) - 1);
+  while (e == 0) 
+    {
+      if (++idx >= last)
+        return b->bit_cnt;
+      e = elem_for (b, idx, value);
+    }
+
+  /* Unused bits in the last element may read as VALUE. */
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -82,6 +144,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->hint = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +167,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->hint = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -214,18 +278,31 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, but the whole group of
+   bits is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      size_t elem_end = (idx + 1) * ELEM_BITS;
+      elem_type mask = range_mask (start, end < elem_end ? end : elem_end);
+
+      /* See bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      start = elem_end;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +310,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      size_t elem_end = (idx + 1) * ELEM_BITS;
+      elem_type mask = range_mask (start, end < elem_end ? end : elem_end);
+      value_cnt += count_ones (elem_for (b, idx, value) & mask);
+      start = elem_end;
+    }
   return value_cnt;
 }
 
@@ -251,16 +334,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,7 +370,12 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Rather than testing every possible starting index, hops from
+   each run of bits set to VALUE to the next, finding the ends of
+   runs an element at a time, so that elements whose bits are all
+   the same are passed over in a single step. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
@@ -302,14 +385,44 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      if (cnt == 0)
+        return start <= last ? start : BITMAP_ERROR;
+      while (start <= last) 
+        {
+          size_t run_start = find_next (b, start, value);
+          size_t run_end;
+          if (run_start > last)
+            break;
+          run_end = find_next (b, run_start, !value);
+          if (run_end - run_start >= cnt)
+            return run_start;
+          start = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
 
+/* Finds and returns the starting index of a group of CNT
+   consecutive bits in B that are all set to VALUE, searching
+   first from where the previous call on B left off and then
+   from the beginning of B ("next fit").  The next call will
+   start searching just past the group found.
+   If there is no such group, returns BITMAP_ERROR. */
+size_t
+bitmap_scan_from_hint (struct bitmap *b, size_t cnt, bool value) 
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  idx = bitmap_scan (b, b->hint, cnt, value);
+  if (idx == BITMAP_ERROR && b->hint > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    b->hint = idx + cnt < b->bit_cnt ? idx + cnt : 0;
+  return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -359,6 +472,27 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE just the elements of B that hold the CNT bits
+   starting at START, at the same place bitmap_write() would put
+   them.  Return true if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt) 
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (start + cnt <= b->bit_cnt);
+  if (cnt == 0)
+    return true;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof (elem_type);
+  size = (last - first + 1) * sizeof (elem_type);
+  return file_write_at (file, b->bits + first, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,62 @@
+/* Measures how many malloc()/free() pairs complete per timer
+   tick for a few block sizes, first through the locked
+   descriptor free lists alone and then with the per-thread
+   magazines in front of them. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+/* Number of ticks to measure each configuration for. */
+#define BENCH_TICKS 20
+
+static long long pairs_per_tick (size_t size);
+
+void
+test_malloc_bench (void) 
+{
+  static const size_t sizes[] = {16, 100, 512, 1024};
+  bool saved = malloc_magazines;
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++) 
+    {
+      long long locked, cached;
+
+      malloc_magazines = false;
+      locked = pairs_per_tick (sizes[i]);
+      malloc_magazines = true;
+      cached = pairs_per_tick (sizes[i]);
+
+      msg ("%zu bytes: %lld pairs/tick locked, %lld pairs/tick magazine",
+           sizes[i], locked, cached);
+    }
+  malloc_magazines = saved;
+  pass ();
+}
+
+/* Returns the average number of malloc()/free() pairs of SIZE
+   bytes done per tick over BENCH_TICKS ticks. */
+static long long
+pairs_per_tick (size_t size) 
+{
+  long long pairs = 0;
+  int64_t start;
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS) 
+    {
+      void *p = malloc (size);
+      if (p == NULL)
+        fail ("malloc (%zu) failed", size);
+      free (p);
+      pairs++;
+    }
+  return pairs / BENCH_TICKS;
+}
@@ -18,6 +18,7 @@
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
+#include "threads/lockstat.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
@@ -247,6 +248,15 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-pio"))
+        ide_use_pio = true;
+      else if (!strcmp (name, "-blkstat"))
+        blkstat_enabled = true;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (!block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -256,6 +266,8 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -373,12 +385,17 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -pio               Use programmed I/O for IDE instead of DMA.\n"
+          "  -iosched=NAME      Use I/O scheduler NAME (clook or fifo).\n"
+          "  -blkstat           Report block device statistics at shutdown.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV         Use BDEV for swap instead of default;\n"
+          "                     best on the other IDE channel (hdc/hdd).\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -lockstat          Report lock contention at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -400,11 +417,14 @@ locate_block_devices (void)
 
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the first block device in probe order of type ROLE,
+   preferring for roles other than the file system one that can
+   transfer data in parallel with the file system device. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
+  struct block *fs = role != BLOCK_FILESYS ? block_get_role (BLOCK_FILESYS)
+                                            : NULL;
   struct block *block = NULL;
 
   if (name != NULL)
@@ -415,14 +435,27 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
+      struct block *first = NULL;
+
       for (block = block_first (); block != NULL; block = block_next (block))
         if (block_type (block) == role)
-          break;
+          {
+            if (first == NULL)
+              first = block;
+            if (fs == NULL || !block_same_queue (block, fs))
+              break;
+          }
+      if (block == NULL)
+        block = first;
     }
 
   if (block != NULL)
     {
       printf ("%s: using %s\n", block_type_name (role), block_name (block));
+      if (role == BLOCK_SWAP && fs != NULL && block_same_queue (block, fs))
+        printf ("%s: on the same IDE channel as %s, so paging and file "
+                "system I/O cannot overlap; put it on hdc or hdd\n",
+                block_name (block), block_name (fs));
       block_set_role (role, block);
     }
 }
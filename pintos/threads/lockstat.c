@@ -0,0 +1,203 @@
+#include "threads/lockstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Wait-time profiler for semaphores, locks, condition variables
+   and threads.
+
+   Waits are grouped by where they happen rather than by the
+   object waited on, since many objects live on the stack or the
+   heap and their addresses are reused: waits on semaphores, locks
+   and condition variables by the code address that called
+   sema_down(), lock_acquire() or cond_wait(), and waits of
+   threads by thread name.  Each group gets a slot in a
+   fixed-size open-addressed table, holding the number and total
+   length of its waits and log2-bucketed histograms of their
+   lengths, in timer ticks and in TSC cycles.  Nothing is
+   allocated, so waits can be recorded with interrupts off, even
+   from thread_block().  A group that finds no slot within
+   LOCKSTAT_PROBES probes is only counted in lockstat_dropped. */
+
+/* Number of table slots.  Must be a power of 2. */
+#define LOCKSTAT_SLOTS 128
+
+/* Most slots examined to find a group's slot. */
+#define LOCKSTAT_PROBES 8
+
+/* Number of histogram buckets.  Bucket B counts waits of at
+   least 2**(B-1) and less than 2**B units; the last bucket also
+   takes everything longer. */
+#define TICK_BUCKETS 16
+#define CYCLE_BUCKETS 40
+
+/* Number of groups shown by lockstat_print_stats(). */
+#define LOCKSTAT_TOP 10
+
+/* Longest thread name kept. */
+#define LOCKSTAT_NAME_LEN 16
+
+/* Profile of one group of waits. */
+struct lockstat_slot
+  {
+    bool in_use;                        /* Is this slot taken? */
+    enum lockstat_kind kind;            /* What is waited on. */
+    const void *site;                   /* Caller, if not a thread. */
+    char name[LOCKSTAT_NAME_LEN];       /* Thread name, if a thread. */
+    unsigned waits;                     /* Number of waits. */
+    int64_t total_ticks;                /* Sum of waits, in ticks. */
+    uint64_t total_cycles;              /* Sum of waits, in cycles. */
+    uint64_t max_cycles;                /* Longest wait, in cycles. */
+    unsigned tick_hist[TICK_BUCKETS];   /* Waits by length in ticks. */
+    unsigned cycle_hist[CYCLE_BUCKETS]; /* Waits by length in cycles. */
+  };
+
+bool lockstat_enabled;
+
+static struct lockstat_slot slots[LOCKSTAT_SLOTS];
+static unsigned lockstat_dropped;
+
+static struct lockstat_slot *find_slot (enum lockstat_kind,
+                                        const void *site, const char *name);
+static int bucket (uint64_t value, int bucket_cnt);
+
+/* Records the start of a wait in STAMP. */
+void
+lockstat_begin (struct lockstat_stamp *stamp)
+{
+  stamp->ticks = timer_ticks ();
+  stamp->cycles = rdtsc ();
+}
+
+/* Records the end of a wait that began at STAMP.  If KIND is
+   LOCKSTAT_THREAD, NAME is the name of the thread that waited;
+   otherwise SITE is the address of the code that waited on a
+   semaphore, lock or condition variable according to KIND. */
+void
+lockstat_end (enum lockstat_kind kind, const void *site, const char *name,
+              const struct lockstat_stamp *stamp)
+{
+  uint64_t cycles = rdtsc () - stamp->cycles;
+  int64_t ticks = timer_ticks () - stamp->ticks;
+  struct lockstat_slot *s;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  s = find_slot (kind, site, name);
+  if (s != NULL)
+    {
+      if (!s->in_use)
+        {
+          s->in_use = true;
+          s->kind = kind;
+          s->site = site;
+          strlcpy (s->name, name != NULL ? name : "", sizeof s->name);
+        }
+      s->waits++;
+      s->total_ticks += ticks;
+      s->total_cycles += cycles;
+      if (cycles > s->max_cycles)
+        s->max_cycles = cycles;
+      s->tick_hist[bucket (ticks, TICK_BUCKETS)]++;
+      s->cycle_hist[bucket (cycles, CYCLE_BUCKETS)]++;
+    }
+  else
+    lockstat_dropped++;
+  intr_set_level (old_level);
+}
+
+/* Prints the LOCKSTAT_TOP groups with the most total wait time,
+   along with their histograms. */
+void
+lockstat_print_stats (void)
+{
+  static const char *kind_names[] = {"sema", "lock", "cond", "thread"};
+  bool shown[LOCKSTAT_SLOTS];
+  int rank;
+
+  memset (shown, 0, sizeof shown);
+  printf ("Lockstat: top %d waits by total cycles (%u dropped)\n",
+          LOCKSTAT_TOP, lockstat_dropped);
+  for (rank = 0; rank < LOCKSTAT_TOP; rank++)
+    {
+      struct lockstat_slot *top = NULL;
+      int i, top_idx = 0;
+
+      for (i = 0; i < LOCKSTAT_SLOTS; i++)
+        if (slots[i].in_use && !shown[i]
+            && (top == NULL || slots[i].total_cycles > top->total_cycles))
+          {
+            top = &slots[i];
+            top_idx = i;
+          }
+      if (top == NULL)
+        break;
+      shown[top_idx] = true;
+
+      if (top->kind == LOCKSTAT_THREAD)
+        printf ("  thread \"%s\"", top->name);
+      else
+        printf ("  %s from %p", kind_names[top->kind], top->site);
+      printf (": %u waits, %"PRId64" ticks, %"PRIu64" cycles "
+              "(max %"PRIu64")\n",
+              top->waits, top->total_ticks, top->total_cycles,
+              top->max_cycles);
+      printf ("    ticks:");
+      for (i = 0; i < TICK_BUCKETS; i++)
+        if (top->tick_hist[i] != 0)
+          printf (" <%"PRIu64":%u", (uint64_t) 1 << i, top->tick_hist[i]);
+      printf ("\n    cycles:");
+      for (i = 0; i < CYCLE_BUCKETS; i++)
+        if (top->cycle_hist[i] != 0)
+          printf (" <2^%d:%u", i, top->cycle_hist[i]);
+      printf ("\n");
+    }
+}
+
+/* Returns the slot for the waits of KIND from SITE or, for
+   threads, by the thread named NAME, which is unused if there
+   have been none before, or a null pointer if no such slot is
+   found within LOCKSTAT_PROBES probes.  Interrupts must be off. */
+static struct lockstat_slot *
+find_slot (enum lockstat_kind kind, const void *site, const char *name)
+{
+  unsigned hash = (uintptr_t) site * 2654435761u;
+  const char *p;
+  unsigned i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (kind == LOCKSTAT_THREAD)
+    for (hash = 2166136261u, p = name; *p != '\0'; p++)
+      hash = (hash ^ (unsigned char) *p) * 16777619u;
+  for (i = 0; i < LOCKSTAT_PROBES; i++)
+    {
+      struct lockstat_slot *s = &slots[(hash + i) % LOCKSTAT_SLOTS];
+      if (!s->in_use
+          || (s->kind == kind
+              && (kind == LOCKSTAT_THREAD
+                  ? !strcmp (s->name, name)
+                  : s->site == site)))
+        return s;
+    }
+  return NULL;
+}
+
+/* Returns the index of the log2 bucket for VALUE, among
+   BUCKET_CNT buckets. */
+static int
+bucket (uint64_t value, int bucket_cnt)
+{
+  int b = 0;
+
+  while (value != 0 && b < bucket_cnt - 1)
+    {
+      value >>= 1;
+      b++;
+    }
+  return b;
+}
@@ -0,0 +1,31 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kinds of objects whose waits are profiled. */
+enum lockstat_kind
+  {
+    LOCKSTAT_SEMA,              /* sema_down(). */
+    LOCKSTAT_LOCK,              /* lock_acquire(). */
+    LOCKSTAT_COND,              /* cond_wait(). */
+    LOCKSTAT_THREAD             /* thread_block(). */
+  };
+
+/* Start of a wait, taken by lockstat_begin(). */
+struct lockstat_stamp
+  {
+    int64_t ticks;              /* timer_ticks() at start. */
+    uint64_t cycles;            /* rdtsc() at start. */
+  };
+
+/* Controlled by kernel command-line option "-lockstat". */
+extern bool lockstat_enabled;
+
+void lockstat_begin (struct lockstat_stamp *);
+void lockstat_end (enum lockstat_kind, const void *site, const char *name,
+                   const struct lockstat_stamp *);
+void lockstat_print_stats (void);
+
+#endif /* threads/lockstat.h */
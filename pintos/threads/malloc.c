@@ -5,8 +5,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,13 +34,27 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the descriptors' free lists, each thread keeps a
+   "magazine" of free blocks per descriptor in its struct thread:
+   a singly linked stack that only the owning thread touches, so
+   that the common malloc() and free() take no lock at all.  An
+   empty magazine is refilled with a batch of blocks from the free
+   list in a single locked operation, and a full one hands a batch
+   back the same way.  Blocks sitting in a magazine count as in
+   use for their arena; they go back to the free list at the
+   latest when their thread exits.  A magazine holds at most about
+   MAG_BYTES bytes, so that threads do not hoard whole pages of
+   big blocks, and a batch is half of that. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t mag_capacity;        /* Most blocks in a magazine. */
+    size_t mag_batch;           /* Blocks moved to or from a magazine. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
   };
@@ -58,20 +74,44 @@ struct arena
 struct block 
   {
     struct list_elem free_elem; /* Free list element. */
+    struct block *mag_next;     /* Next block in a magazine. */
   };
 
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Size-class lookup: desc_of_size[(SIZE - 1) / CLASS_GRANULE] is
+   the index in descs[] of the smallest descriptor that satisfies
+   a SIZE-byte request, for SIZE up to MAX_CLASS_SIZE. */
+#define CLASS_GRANULE 16
+#define MAX_CLASS_SIZE (PGSIZE / 4)
+static uint8_t desc_of_size[MAX_CLASS_SIZE / CLASS_GRANULE];
+
+/* Bytes of blocks a magazine may hold, and bounds on its
+   capacity in blocks. */
+#define MAG_BYTES 2048
+#define MAG_MIN_CAPACITY 2
+#define MAG_MAX_CAPACITY 32
+
+/* If false, malloc() and free() bypass the magazines and go
+   straight to the locked free lists. */
+bool malloc_magazines = true;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool desc_add_arena (struct desc *);
+static struct block *desc_take_block (struct desc *);
+static void desc_give_block (struct desc *, struct block *);
+static bool magazine_refill (struct desc *, struct magazine *);
+static void magazine_drain (struct desc *, struct magazine *, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
@@ -79,9 +119,26 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->mag_capacity = MAG_BYTES / block_size;
+      if (d->mag_capacity < MAG_MIN_CAPACITY)
+        d->mag_capacity = MAG_MIN_CAPACITY;
+      else if (d->mag_capacity > MAG_MAX_CAPACITY)
+        d->mag_capacity = MAG_MAX_CAPACITY;
+      d->mag_batch = d->mag_capacity / 2;
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
+  ASSERT (descs[desc_cnt - 1].block_size == MAX_CLASS_SIZE);
+
+  for (i = 0; i < sizeof desc_of_size; i++)
+    {
+      size_t size = (i + 1) * CLASS_GRANULE;
+      size_t d = 0;
+      while (descs[d].block_size < size)
+        d++;
+      desc_of_size[i] = d;
+    }
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -99,10 +156,7 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  if (size > MAX_CLASS_SIZE) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -118,37 +172,25 @@ malloc (size_t size)
       a->free_cnt = page_cnt;
       return a + 1;
     }
+  d = &descs[desc_of_size[(size - 1) / CLASS_GRANULE]];
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Common case: pop a block from this thread's magazine. */
+  if (malloc_magazines)
     {
-      size_t i;
+      struct magazine *m;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      ASSERT (!intr_context ());
+      m = &thread_current ()->magazines[d - descs];
+      if (m->cnt == 0 && !magazine_refill (d, m))
+        return NULL;
+      b = m->top;
+      m->top = b->mag_next;
+      m->cnt--;
+      return b;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  lock_acquire (&d->lock);
+  b = desc_take_block (d);
   lock_release (&d->lock);
   return b;
 }
@@ -233,25 +275,24 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Common case: push the block onto this thread's
+             magazine, making room first if it is full. */
+          if (malloc_magazines)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              struct magazine *m;
+
+              ASSERT (!intr_context ());
+              m = &thread_current ()->magazines[d - descs];
+              if (m->cnt >= d->mag_capacity)
+                magazine_drain (d, m, d->mag_batch);
+              b->mag_next = m->top;
+              m->top = b;
+              m->cnt++;
+              return;
             }
 
+          lock_acquire (&d->lock);
+          desc_give_block (d, b);
           lock_release (&d->lock);
         }
       else
@@ -263,6 +304,133 @@ free (void *p)
     }
 }
 
+/* Returns every block in the current thread's magazines to the
+   descriptors' free lists.  Called when the thread exits. */
+void
+malloc_thread_exit (void) 
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    if (t->magazines[i].cnt > 0)
+      magazine_drain (&descs[i], &t->magazines[i], t->magazines[i].cnt);
+}
+
+/* Fills empty magazine M with up to D's batch of blocks from
+   descriptor D.  Returns false if not even one block could be
+   obtained. */
+static bool
+magazine_refill (struct desc *d, struct magazine *m) 
+{
+  ASSERT (m->cnt == 0);
+
+  lock_acquire (&d->lock);
+  while (m->cnt < d->mag_batch)
+    {
+      struct block *b = desc_take_block (d);
+      if (b == NULL)
+        break;
+      b->mag_next = m->top;
+      m->top = b;
+      m->cnt++;
+    }
+  lock_release (&d->lock);
+
+  return m->cnt > 0;
+}
+
+/* Returns CNT blocks from magazine M to descriptor D. */
+static void
+magazine_drain (struct desc *d, struct magazine *m, size_t cnt) 
+{
+  ASSERT (cnt <= m->cnt);
+
+  lock_acquire (&d->lock);
+  for (; cnt > 0; cnt--)
+    {
+      struct block *b = m->top;
+      m->top = b->mag_next;
+      m->cnt--;
+      desc_give_block (d, b);
+    }
+  lock_release (&d->lock);
+}
+
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty.  Returns a null pointer if memory is not
+   available.  D's lock must be held. */
+static struct block *
+desc_take_block (struct desc *d) 
+{
+  struct block *b;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list) && !desc_add_arena (d))
+    return NULL;
+
+  /* Get a block from free list. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  block_to_arena (b)->free_cnt--;
+  return b;
+}
+
+/* Puts block B back on D's free list, giving its arena back to
+   the page allocator if that leaves it entirely unused.  D's lock
+   must be held. */
+static void
+desc_give_block (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+    }
+}
+
+/* Allocates a new arena for D and adds its blocks to D's free
+   list.  Returns false if no page is available.  D's lock must
+   be held. */
+static bool
+desc_add_arena (struct desc *d) 
+{
+  struct arena *a;
+  size_t i;
+
+  /* Allocate a page. */
+  a = palloc_get_page (0);
+  if (a == NULL) 
+    return false;
+
+  /* Initialize arena and add its blocks to the free list. */
+  a->magic = ARENA_MAGIC;
+  a->desc = d;
+  a->free_cnt = d->blocks_per_arena;
+  for (i = 0; i < d->blocks_per_arena; i++) 
+    {
+      struct block *b = arena_to_block (a, i);
+      list_push_back (&d->free_list, &b->free_elem);
+    }
+  return true;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -2,9 +2,24 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Number of malloc() size classes, from 16 to 1024 bytes. */
+#define MALLOC_CLASS_CNT 7
+
+/* A thread's cache of free blocks of one size class.
+   Owned by malloc.c. */
+struct magazine
+  {
+    void *top;                  /* Most recently freed block. */
+    unsigned cnt;               /* Number of blocks. */
+  };
+
+extern bool malloc_magazines;
+
 void malloc_init (void);
+void malloc_thread_exit (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
@@ -7,8 +7,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <list.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,58 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**K pages whose
+   page index within the pool is a multiple of 2**K, one free
+   list per order K, so allocation takes the smallest free block
+   that is big enough and splits it in halves as needed, and
+   freeing merges a block with its "buddy" (the other half of the
+   block twice its size) for as long as the buddy is also free.
+   Both take O(log n) time.  A request that is not a power of 2
+   gives back the unused tail of its block right away, and is
+   freed as a series of aligned power-of-2 blocks, so that
+   callers see no difference from the first-fit allocator that
+   this replaces.
+
+   A free list element is stored in the first page of each free
+   block, and the order of each free block is recorded in a byte
+   per page, so that a block's buddy can be found and checked
+   without searching.  The used_map bitmap still records which
+   pages are allocated.  It is used for sanity checks and for the
+   rare allocation that no single free block can satisfy even
+   though enough contiguous pages are free, which falls back to a
+   first-fit search of the bitmap.
+
+   A pool is protected by disabling interrupts rather than by a
+   lock, because pages are freed by the scheduler, which cannot
+   block, and the critical sections are short. */
+
+/* Number of block orders: blocks range from 1 to 2**19 pages. */
+#define ORDER_CNT 20
+
+/* Value in a pool's free_order for a page that does not begin a
+   free block. */
+#define NOT_FREE 0xff
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
+    struct bitmap *used_map;            /* Bitmap of allocated pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    uint8_t *free_order;                /* Order of free block at page. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks of each order. */
+    size_t free_cnt[ORDER_CNT];         /* Length of each free list. */
+    size_t free_pages;                  /* Number of free pages. */
+
+    /* Statistics. */
+    unsigned long long splits;          /* Blocks split in two. */
+    unsigned long long merges;          /* Buddies merged. */
+    unsigned long long fallbacks;       /* First-fit allocations. */
+    unsigned long long failures;        /* Allocations that failed. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +84,10 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (const struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,9 +126,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  page_idx = pool_alloc (pool, page_cnt);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -137,8 +184,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool_free (pool, page_idx, page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +194,26 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Prints statistics about both pools, including how fragmented
+   their free memory is. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  size_t i;
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +221,22 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->name = name;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, NOT_FREE, page_cnt);
+  for (i = 0; i < ORDER_CNT; i++) 
+    {
+      list_init (&p->free_lists[i]);
+      p->free_cnt[i] = 0;
+    }
+  p->free_pages = 0;
+  p->splits = p->merges = p->fallbacks = p->failures = 0;
+
+  /* Put all of the pool's pages on the free lists. */
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +246,238 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element stored in the page with index
+   PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx) 
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page in POOL that holds ELEM. */
+static size_t
+block_idx (const struct pool *pool, struct list_elem *elem) 
+{
+  return pg_no (elem) - pg_no (pool->base);
+}
+
+/* Adds the free block of 2**ORDER pages starting at PAGE_IDX to
+   POOL's free lists. */
+static void
+block_insert (struct pool *pool, size_t page_idx, unsigned order) 
+{
+  pool->free_order[page_idx] = order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+  pool->free_cnt[order]++;
+}
+
+/* Removes the free block starting at PAGE_IDX from POOL's free
+   lists and returns its order. */
+static unsigned
+block_remove (struct pool *pool, size_t page_idx) 
+{
+  unsigned order = pool->free_order[page_idx];
+
+  ASSERT (order < ORDER_CNT);
+  list_remove (block_elem (pool, page_idx));
+  pool->free_cnt[order]--;
+  pool->free_order[page_idx] = NOT_FREE;
+  return order;
+}
+
+/* Frees the block of 2**ORDER pages starting at PAGE_IDX in
+   POOL, merging it with its buddy for as long as the buddy is
+   free too. */
+static void
+block_free (struct pool *pool, size_t page_idx, unsigned order) 
+{
+  while (order + 1 < ORDER_CNT) 
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx >= pool->page_cnt
+          || pool->free_order[buddy_idx] != order)
+        break;
+      block_remove (pool, buddy_idx);
+      page_idx &= ~((size_t) 1 << order);
+      order++;
+      pool->merges++;
+    }
+  block_insert (pool, page_idx, order);
+}
+
+/* Returns the order of the largest block that starts at PAGE_IDX
+   and holds no more than PAGE_CNT pages, which must be
+   positive. */
+static unsigned
+largest_order (size_t page_idx, size_t page_cnt) 
+{
+  unsigned order = page_idx != 0 ? __builtin_ctz (page_idx) : ORDER_CNT - 1;
+  if (order > ORDER_CNT - 1)
+    order = ORDER_CNT - 1;
+  while (((size_t) 1 << order) > page_cnt)
+    order--;
+  return order;
+}
+
+/* Marks the PAGE_CNT pages starting at PAGE_IDX in POOL as free,
+   splitting them into as few aligned blocks as possible.
+   Interrupts must be off. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  pool->free_pages += page_cnt;
+  while (page_cnt > 0) 
+    {
+      unsigned order = largest_order (page_idx, page_cnt);
+      block_free (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes the PAGE_CNT pages starting at PAGE_IDX in POOL, all of
+   which must be free, off the free lists.  Parts of the free
+   blocks containing them that lie outside the range are put
+   back.  Interrupts must be off. */
+static void
+carve_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t end_idx = page_idx + page_cnt;
+  size_t idx = page_idx;
+
+  while (idx < end_idx) 
+    {
+      /* Find the free block that contains page IDX. */
+      size_t head_idx;
+      size_t head_end;
+      unsigned order;
+
+      for (order = 0; ; order++) 
+        {
+          ASSERT (order < ORDER_CNT);
+          head_idx = idx & ~(((size_t) 1 << order) - 1);
+          if (pool->free_order[head_idx] == order)
+            break;
+        }
+      block_remove (pool, head_idx);
+      pool->free_pages -= (size_t) 1 << order;
+      head_end = head_idx + ((size_t) 1 << order);
+
+      /* Give back the parts outside the range. */
+      if (head_idx < page_idx)
+        free_range (pool, head_idx, page_idx - head_idx);
+      if (head_end > end_idx)
+        free_range (pool, end_idx, head_end - end_idx);
+      idx = head_end;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no such run of
+   pages is free. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt) 
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  unsigned want, order;
+
+  for (want = 0; want < ORDER_CNT && ((size_t) 1 << want) < page_cnt; want++)
+    continue;
+
+  old_level = intr_disable ();
+
+  /* Take the smallest free block that is big enough. */
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+
+  if (order < ORDER_CNT) 
+    {
+      size_t block_cnt = (size_t) 1 << want;
+
+      page_idx = block_idx (pool, list_front (&pool->free_lists[order]));
+      block_remove (pool, page_idx);
+      pool->free_pages -= (size_t) 1 << order;
+
+      /* Split it until it is the size wanted, keeping the lower
+         half each time. */
+      while (order > want) 
+        {
+          order--;
+          block_insert (pool, page_idx + ((size_t) 1 << order), order);
+          pool->free_pages += (size_t) 1 << order;
+          pool->splits++;
+        }
+
+      /* Give back the pages beyond PAGE_CNT. */
+      if (block_cnt > page_cnt)
+        free_range (pool, page_idx + page_cnt, block_cnt - page_cnt);
+    }
+  else if (page_cnt <= pool->free_pages) 
+    {
+      /* No free block is big enough, but enough free pages might
+         still be contiguous across block boundaries. */
+      page_idx = bitmap_scan (pool->used_map, 0, page_cnt, false);
+      if (page_idx != BITMAP_ERROR) 
+        {
+          carve_range (pool, page_idx, page_cnt);
+          pool->fallbacks++;
+        }
+    }
+
+  if (page_idx != BITMAP_ERROR) 
+    {
+      ASSERT (!bitmap_any (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  else
+    pool->failures++;
+
+  intr_set_level (old_level);
+
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+
+  intr_set_level (old_level);
+}
+
+/* Prints statistics for POOL. */
+static void
+print_pool_stats (const struct pool *pool) 
+{
+  size_t largest = 0;
+  unsigned order;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    if (pool->free_cnt[order] > 0)
+      largest = (size_t) 1 << order;
+
+  printf ("Palloc %s: %zu of %zu pages free, largest free block %zu pages, "
+          "%zu%% fragmented\n",
+          pool->name, pool->free_pages, pool->page_cnt, largest,
+          pool->free_pages > 0
+          ? 100 - largest * 100 / pool->free_pages : (size_t) 0);
+  printf ("  free blocks by order:");
+  for (order = 0; order < ORDER_CNT; order++)
+    if (pool->free_cnt[order] > 0)
+      printf (" %u:%zu", order, pool->free_cnt[order]);
+  printf ("\n  %llu splits, %llu merges, %llu first-fit fallbacks, "
+          "%llu failures\n",
+          pool->splits, pool->merges, pool->fallbacks, pool->failures);
+}
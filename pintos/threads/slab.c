@@ -0,0 +1,301 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size kernel objects.
+
+   A cache hands out objects of a single size, carved out of
+   "slabs": pages obtained from the page allocator with a slab
+   header at the beginning, followed by as many objects as fit.
+   Unlike malloc(), which rounds every request up to a power of
+   2, a cache packs objects at their own size (rounded up to a
+   word), and objects of one kind stay together in memory.
+
+   If the cache has a constructor, it is run on every object
+   once, when its slab is created, rather than on every
+   allocation.  A freed object must therefore be handed back in
+   its constructed state, and is handed out again that way.
+   Because of that, a free object's link in its slab's free list
+   is kept in an extra word after the object, not inside it.
+
+   Each cache keeps its slabs on three lists, by how many of
+   their objects are in use.  Allocation takes from a partially
+   used slab first, then from an empty one, and only then
+   creates a new slab.  At most one empty slab is kept; others
+   go back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A cache. */
+struct kmem_cache
+  {
+    struct list_elem elem;      /* Element in cache_list. */
+    char name[16];              /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t slot_size;           /* Object plus free-list link. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct lock lock;           /* Protects the members below. */
+    struct list full;           /* Slabs with no free object. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list empty;          /* Slabs with no used object. */
+
+    /* Statistics. */
+    unsigned long long allocs;  /* Objects allocated. */
+    unsigned long long frees;   /* Objects freed. */
+    size_t slab_cnt;            /* Slabs currently owned. */
+    size_t in_use;              /* Objects currently allocated. */
+  };
+
+/* A slab, at the beginning of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free;                 /* First free object, or null. */
+  };
+
+/* All caches, for kmem_print_stats(). */
+static struct list cache_list = LIST_INITIALIZER (cache_list);
+static struct lock cache_list_lock;
+static bool cache_list_lock_ready;
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct slab *);
+static struct slab *object_to_slab (struct kmem_cache *, void *);
+static void **free_link (struct kmem_cache *, void *);
+
+/* Creates and returns a cache named NAME for objects of SIZE
+   bytes.  If CTOR is non-null, it is run on each object when the
+   object's slab is created.  Returns a null pointer if memory is
+   not available.  SIZE must be small enough that at least one
+   object fits in a page along with the slab header. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+
+  strlcpy (c->name, name, sizeof c->name);
+  c->obj_size = ROUND_UP (size, sizeof (void *));
+  c->slot_size = c->obj_size + sizeof (void *);
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->slot_size;
+  ASSERT (c->objs_per_slab > 0);
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->full);
+  list_init (&c->partial);
+  list_init (&c->empty);
+  c->allocs = c->frees = 0;
+  c->slab_cnt = c->in_use = 0;
+
+  if (!cache_list_lock_ready)
+    {
+      lock_init (&cache_list_lock);
+      cache_list_lock_ready = true;
+    }
+  lock_acquire (&cache_list_lock);
+  list_push_back (&cache_list, &c->elem);
+  lock_release (&cache_list_lock);
+
+  return c;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (c != NULL);
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else if (!list_empty (&c->empty))
+    s = list_entry (list_front (&c->empty), struct slab, elem);
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+    }
+
+  /* Take the first free object and refile the slab. */
+  obj = s->free;
+  s->free = *free_link (c, obj);
+  list_remove (&s->elem);
+  list_push_front (--s->free_cnt == 0 ? &c->full : &c->partial, &s->elem);
+
+  c->allocs++;
+  c->in_use++;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to
+   C.  If C has a constructor, OBJ must be in its constructed
+   state. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = object_to_slab (c, obj);
+  lock_acquire (&c->lock);
+  *free_link (c, obj) = s->free;
+  s->free = obj;
+  list_remove (&s->elem);
+  if (++s->free_cnt < c->objs_per_slab)
+    list_push_front (&c->partial, &s->elem);
+  else if (list_empty (&c->empty))
+    list_push_front (&c->empty, &s->elem);
+  else
+    slab_destroy (s);
+
+  c->frees++;
+  c->in_use--;
+  lock_release (&c->lock);
+}
+
+/* Destroys cache C, giving its slabs back to the page allocator.
+   No object of C may be in use. */
+void
+kmem_cache_destroy (struct kmem_cache *c)
+{
+  if (c == NULL)
+    return;
+
+  ASSERT (c->in_use == 0);
+  ASSERT (list_empty (&c->full) && list_empty (&c->partial));
+
+  lock_acquire (&cache_list_lock);
+  list_remove (&c->elem);
+  lock_release (&cache_list_lock);
+
+  while (!list_empty (&c->empty))
+    slab_destroy (list_entry (list_pop_front (&c->empty),
+                              struct slab, elem));
+  free (c);
+}
+
+/* Prints statistics for cache C. */
+void
+kmem_cache_print_stats (const struct kmem_cache *c)
+{
+  printf ("Slab %s: %zu-byte objects, %zu in use, %zu slabs, "
+          "%llu allocs, %llu frees\n",
+          c->name, c->obj_size, c->in_use, c->slab_cnt,
+          c->allocs, c->frees);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e))
+    kmem_cache_print_stats (list_entry (e, struct kmem_cache, elem));
+}
+
+/* Creates a new slab for cache C, runs C's constructor on its
+   objects, and puts it on C's empty list.  Returns a null
+   pointer if no page is available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *obj;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free = NULL;
+
+  /* Thread the objects onto the free list, last one first, so
+     that they are handed out in address order. */
+  obj = (uint8_t *) (s + 1) + c->objs_per_slab * c->slot_size;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      obj -= c->slot_size;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *free_link (c, obj) = s->free;
+      s->free = obj;
+    }
+
+  list_push_front (&c->empty, &s->elem);
+  c->slab_cnt++;
+  return s;
+}
+
+/* Gives slab S, which must not be on any list and must have no
+   objects in use, back to the page allocator. */
+static void
+slab_destroy (struct slab *s)
+{
+  ASSERT (s->free_cnt == s->cache->objs_per_slab);
+
+  s->cache->slab_cnt--;
+  s->magic = 0;
+  palloc_free_page (s);
+}
+
+/* Returns the slab that OBJ, an object of cache C, is inside. */
+static struct slab *
+object_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT ((pg_ofs (obj) - sizeof *s) % c->slot_size == 0);
+
+  return s;
+}
+
+/* Returns the free-list link that follows OBJ, an object of
+   cache C. */
+static void **
+free_link (struct kmem_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->obj_size);
+}
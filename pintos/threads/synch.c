@@ -27,11 +27,24 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of lock holders that a priority
+   donation is propagated along. */
+#define DONATION_MAX_DEPTH 8
+
+static void sema_wait (struct semaphore *);
+static void donate_priority (struct lock *);
+static void lock_taken (struct lock *);
+static void lock_stats_add (struct lock_stats *, bool contended,
+                            int64_t wait_start);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -60,19 +73,76 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
+  struct lockstat_stamp stamp;
   enum intr_level old_level;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  if (lockstat_enabled && sema->value == 0)
+    {
+      lockstat_begin (&stamp);
+      sema_wait (sema);
+      lockstat_end (LOCKSTAT_SEMA, __builtin_return_address (0), NULL,
+                    &stamp);
+    }
+  else
+    sema_wait (sema);
+  intr_set_level (old_level);
+}
+
+/* Does the work of sema_down(), without profiling it, for
+   callers that profile the wait under their own object.
+   Interrupts must be off. */
+static void
+sema_wait (struct semaphore *sema) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
   while (sema->value == 0) 
     {
       list_push_back (&sema->waiters, &thread_current ()->elem);
       thread_block ();
     }
   sema->value--;
+}
+
+/* Down or "P" operation on a semaphore that gives up after
+   TICKS timer ticks.  Returns true if SEMA was decremented, false
+   if the timeout expired first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but if it sleeps then the next scheduled
+   thread will probably turn interrupts back on. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  enum intr_level old_level;
+  int64_t deadline;
+  bool success = true;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  deadline = timer_ticks () + ticks;
+  while (sema->value == 0) 
+    {
+      if (timer_ticks () >= deadline)
+        {
+          success = false;
+          break;
+        }
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block_until (deadline);
+    }
+  if (success)
+    sema->value--;
   intr_set_level (old_level);
+
+  return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -102,7 +172,11 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running thread.
+
+   Waiters are not kept sorted, because donation can change their
+   priority while they wait; the highest one is picked here.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,9 +188,14 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *max = list_max (&sema->waiters,
+                                        thread_cmp_priority, NULL);
+      list_remove (max);
+      thread_unblock (list_entry (max, struct thread, elem));
+    }
   sema->value++;
+  thread_yield_for_higher_priority ();
   intr_set_level (old_level);
 }
 
@@ -179,12 +258,17 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  memset (&lock->stats, 0, sizeof lock->stats);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   holder of LOCK and, transitively, to the holders of the locks
+   those threads are waiting for (see donate_priority()).
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +276,146 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  struct lockstat_stamp stamp;
+  enum intr_level old_level;
+  bool contended;
+  int64_t wait_start = 0;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  contended = lock->holder != NULL;
+  if (contended)
+    {
+      wait_start = timer_ticks ();
+      if (lockstat_enabled)
+        lockstat_begin (&stamp);
+      if (!thread_mlfqs)
+        {
+          cur->waiting_on_lock = lock;
+          donate_priority (lock);
+        }
+    }
+
+  sema_wait (&lock->semaphore);
+
+  cur->waiting_on_lock = NULL;
+  lock_taken (lock);
+  lock_stats_add (&lock->stats, contended, wait_start);
+  if (contended && lockstat_enabled)
+    lockstat_end (LOCKSTAT_LOCK, __builtin_return_address (0), NULL,
+                  &stamp);
+  intr_set_level (old_level);
+}
+
+/* Like lock_acquire(), but gives up if LOCK cannot be acquired
+   within TICKS timer ticks.  Returns true if LOCK was acquired,
+   false if the timeout expired first.  On timeout, the priority
+   donated to the holder of LOCK is withdrawn.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool contended;
+  bool success;
+  int64_t wait_start = 0;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  contended = lock->holder != NULL;
+  if (contended)
+    {
+      wait_start = timer_ticks ();
+      if (!thread_mlfqs)
+        {
+          cur->waiting_on_lock = lock;
+          donate_priority (lock);
+        }
+    }
+
+  success = sema_down_timeout (&lock->semaphore, ticks);
+
+  cur->waiting_on_lock = NULL;
+  if (success)
+    {
+      lock_taken (lock);
+      lock_stats_add (&lock->stats, contended, wait_start);
+    }
+  else if (!thread_mlfqs && lock->holder != NULL)
+    thread_refresh_priority (lock->holder);
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Records that the current thread now holds LOCK.  Interrupts
+   must be off. */
+static void
+lock_taken (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  if (!thread_mlfqs)
+    {
+      list_push_back (&cur->held_locks, &lock->elem);
+      thread_refresh_priority (cur);
+    }
+}
+
+/* Counts one acquisition in STATS.  If it was CONTENDED, the
+   wait that began at timer tick WAIT_START is counted too. */
+static void
+lock_stats_add (struct lock_stats *stats, bool contended, int64_t wait_start)
+{
+  stats->acquisitions++;
+  if (contended)
+    {
+      stats->contended++;
+      stats->wait_ticks += timer_elapsed (wait_start);
+    }
+}
+
+/* Prints the contention counters in STATS, labeled NAME. */
+void
+lock_stats_print (const struct lock_stats *stats, const char *name)
+{
+  printf ("%s: %u acquisitions, %u contended, %"PRId64" ticks waited\n",
+          name, stats->acquisitions, stats->contended, stats->wait_ticks);
+}
+
+/* Propagates the current thread's priority to the holder of
+   LOCK, then along the chain of locks that each holder is itself
+   waiting for, up to DONATION_MAX_DEPTH links.  Interrupts must
+   be off. */
+static void
+donate_priority (struct lock *lock)
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_MAX_DEPTH; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL || holder->priority >= priority)
+        break;
+      thread_donate_priority (holder, priority);
+      lock = holder->waiting_on_lock;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +434,19 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock_taken (lock);
+      lock_stats_add (&lock->stats, false, 0);
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated through LOCK is given back: the current
+   thread's priority is recomputed from the waiters of the locks
+   it still holds.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +454,20 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    {
+      list_remove (&lock->elem);
+      thread_refresh_priority (thread_current ());
+    }
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,8 +486,22 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has
+   lower priority than the one waiting on B. */
+static bool
+semaphore_elem_cmp_priority (const struct list_elem *a,
+                             const struct list_elem *b,
+                             void *aux UNUSED)
+{
+  const struct semaphore_elem *sa = list_entry (a, struct semaphore_elem, elem);
+  const struct semaphore_elem *sb = list_entry (b, struct semaphore_elem, elem);
+
+  return sa->thread->priority < sb->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -288,6 +537,8 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  struct lockstat_stamp stamp;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -295,14 +546,23 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
+  if (lockstat_enabled)
+    lockstat_begin (&stamp);
   lock_release (lock);
-  sema_down (&waiter.semaphore);
+  old_level = intr_disable ();
+  sema_wait (&waiter.semaphore);
+  intr_set_level (old_level);
+  if (lockstat_enabled)
+    lockstat_end (LOCKSTAT_COND, __builtin_return_address (0), NULL,
+                  &stamp);
   lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +577,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *max = list_max (&cond->waiters,
+                                        semaphore_elem_cmp_priority, NULL);
+      list_remove (max);
+      sema_up (&list_entry (max, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +600,131 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes reader-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.  In RWLOCK_PREFER_READERS
+   mode, readers keep entering as long as no writer is inside,
+   which maximizes read concurrency but can starve writers.  In
+   RWLOCK_PREFER_WRITERS mode, a waiting writer keeps new readers
+   out, so it gets in as soon as the current readers leave. */
+void
+rwlock_init (struct rwlock *rw, enum rwlock_mode mode)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers);
+  cond_init (&rw->writers);
+  rw->reader_cnt = 0;
+  rw->waiting_writers = 0;
+  rw->writer = NULL;
+  rw->mode = mode;
+  memset (&rw->stats, 0, sizeof rw->stats);
+}
+
+/* Acquires RW for reading, sleeping until no writer is inside
+   (and, in RWLOCK_PREFER_WRITERS mode, none is waiting).
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  bool contended = false;
+  int64_t wait_start = 0;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL
+         || (rw->mode == RWLOCK_PREFER_WRITERS && rw->waiting_writers > 0))
+    {
+      if (!contended)
+        {
+          contended = true;
+          wait_start = timer_ticks ();
+        }
+      cond_wait (&rw->readers, &rw->lock);
+    }
+  rw->reader_cnt++;
+  lock_stats_add (&rw->stats, contended, wait_start);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->writers, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or other
+   writer is inside.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  bool contended = false;
+  int64_t wait_start = 0;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writers++;
+  while (rw->writer != NULL || rw->reader_cnt > 0)
+    {
+      if (!contended)
+        {
+          contended = true;
+          wait_start = timer_ticks ();
+        }
+      cond_wait (&rw->writers, &rw->lock);
+    }
+  rw->waiting_writers--;
+  rw->writer = thread_current ();
+  lock_stats_add (&rw->stats, contended, wait_start);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for writing,
+   and lets in either the waiting readers or the next writer
+   according to RW's mode. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (rw->mode == RWLOCK_PREFER_WRITERS && rw->waiting_writers > 0)
+    cond_signal (&rw->writers, &rw->lock);
+  else
+    {
+      cond_broadcast (&rw->readers, &rw->lock);
+      cond_signal (&rw->writers, &rw->lock);
+    }
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
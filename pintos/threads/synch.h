@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -13,19 +14,33 @@ struct semaphore
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention counters of a lock or reader-writer lock. */
+struct lock_stats
+  {
+    unsigned acquisitions;      /* Successful acquisitions. */
+    unsigned contended;         /* Acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Timer ticks spent waiting. */
+  };
+
+void lock_stats_print (const struct lock_stats *, const char *name);
+
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+    struct lock_stats stats;    /* Contention counters. */
   };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
@@ -41,6 +56,34 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Which side a reader-writer lock favors when both readers and
+   writers are waiting. */
+enum rwlock_mode
+  {
+    RWLOCK_PREFER_READERS,      /* Readers may pass waiting writers. */
+    RWLOCK_PREFER_WRITERS       /* Waiting writers hold off new readers. */
+  };
+
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers;   /* Signaled when readers may enter. */
+    struct condition writers;   /* Signaled when a writer may enter. */
+    unsigned reader_cnt;        /* Number of readers inside. */
+    unsigned waiting_writers;   /* Number of writers waiting. */
+    struct thread *writer;      /* Writer inside, if any. */
+    enum rwlock_mode mode;      /* Reader or writer preference. */
+    struct lock_stats stats;    /* Contention counters. */
+  };
+
+void rwlock_init (struct rwlock *, enum rwlock_mode);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
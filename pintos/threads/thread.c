@@ -7,12 +7,16 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/lockstat.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 #include "threads/malloc.h"
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -22,14 +26,40 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-
-/* List of processes that are in the THREAD_BLOCKED state because
-   of a call to function thread_sleep (). */
-static struct list sleeping_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit P of
+   ready_bitmap is set iff ready_queues[P] is non-empty, so that
+   picking, inserting and removing a thread are all O(1). */
+#define READY_BITMAP_WORDS ((PRI_MAX + 1 + 31) / 32)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_bitmap[READY_BITMAP_WORDS];
+static size_t ready_threads;    /* # of threads in ready_queues. */
+
+/* Returned by ready_queue_max_priority() on an empty run queue. */
+#define PRI_NONE (PRI_MIN - 1)
+
+
+/* Processes that are in the THREAD_BLOCKED state because of a
+   call to function thread_sleep () or thread_block_until (),
+   kept in a two-level timer wheel keyed on wakeup_at_tick.  A
+   thread due within SLEEP_WHEEL0_SIZE ticks sits in the level-0
+   slot of its exact wake-up tick; one due within
+   SLEEP_WHEEL1_SIZE such spans sits in the level-1 slot of its
+   span and is cascaded down to level 0 when that span begins;
+   anything further out waits on sleep_overflow until the level-1
+   wheel wraps around.  The timer interrupt thus only looks at the
+   single slot for the current tick instead of every sleeping
+   thread. */
+#define SLEEP_WHEEL0_BITS 8
+#define SLEEP_WHEEL0_SIZE (1 << SLEEP_WHEEL0_BITS)
+#define SLEEP_WHEEL1_BITS 6
+#define SLEEP_WHEEL1_SIZE (1 << SLEEP_WHEEL1_BITS)
+static struct list sleep_wheel0[SLEEP_WHEEL0_SIZE];
+static struct list sleep_wheel1[SLEEP_WHEEL1_SIZE];
+static struct list sleep_overflow;
+static int64_t sleep_wheel_tick;  /* Next tick the wheel will process. */
+static size_t sleeping_threads;   /* # of threads in the wheel. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -69,6 +99,13 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 bool thread_mlfqs;
 FPReal load_avg = 0;
 
+/* The once-per-second recent_cpu decays performed so far.  Only
+   the running and ready threads are decayed on time; a blocked
+   thread applies all the decays it missed at once, from the
+   difference between this and its own mark, when it is
+   unblocked. */
+static struct decay_mark decay_now = {0, 0, 1u << 30, 0, 0};
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -80,14 +117,17 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static void thread_change_priority (struct thread *, int priority);
+static void sleep_wheel_insert (struct thread *);
+static void sleep_wheel_cascade (struct list *);
 void check_sleeping_threads(void);
 void thread_recalculate_priority(struct thread *, void *);
-void thread_recalculate_priority_all_threads(void);
 void thread_recalculate_load_avg(void);
 void thread_recalculate_recent_cpu (struct thread *, void *);
-void thread_recalculate_recent_cpu_all_threads(void);
-void thread_yield_for_higher_priority(void);
-bool thread_cmp_priority (const struct list_elem *, const struct list_elem *, void *);
+static void thread_decay_recent_cpu (void);
 
 struct thread *
 thread_get_by_tid (int tid) {
@@ -140,11 +180,18 @@ thread_get_children_by_tid (int tid) {
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
-  list_init (&sleeping_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  for (i = 0; i < SLEEP_WHEEL0_SIZE; i++)
+    list_init (&sleep_wheel0[i]);
+  for (i = 0; i < SLEEP_WHEEL1_SIZE; i++)
+    list_init (&sleep_wheel1[i]);
+  list_init (&sleep_overflow);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -172,49 +219,136 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Put the to-sleep thread into the sleeping_list.
-   Set the sleeping thread wake-up tick and block it. */
+/* Puts the current thread to sleep until timer tick WAKEUPTICK.
+   Returns immediately if that tick has already been reached. */
 void
 thread_sleep(int64_t wakeuptick)
 {
   enum intr_level old_lvl = intr_disable ();
 
-  struct thread * th = thread_current ();
-  th->wakeup_at_tick = wakeuptick;
-  list_push_back (&sleeping_list, &th->elem);
-  thread_block ();
+  if (wakeuptick > timer_ticks ())
+  {
+    struct thread * th = thread_current ();
+    th->wakeup_at_tick = wakeuptick;
+    sleep_wheel_insert (th);
+    sleeping_threads++;
+    thread_block ();
+  }
   intr_set_level (old_lvl);
 }
 
-/* Iterate through the sleeping threads and see if
-   there is one whose sleep time has already elapsed. */
+/* Blocks the current thread like thread_block(), but also wakes
+   it up when timer tick DEADLINE is reached.  The caller must
+   already have put the thread's `elem' on some wait list; on
+   timeout it is removed from that list.  Returns true if the
+   thread was woken by thread_unblock() before the deadline, false
+   on timeout.
+
+   Must be called with interrupts off and a DEADLINE that has not
+   been reached yet. */
+bool
+thread_block_until (int64_t deadline)
+{
+  struct thread * cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (deadline > timer_ticks ());
+
+  cur->wakeup_at_tick = deadline;
+  cur->timed_wait = true;
+  cur->timed_out = false;
+  sleep_wheel_insert (cur);
+  sleeping_threads++;
+  thread_block ();
+
+  return !cur->timed_out;
+}
+
+/* Files sleeping thread TH into the timer wheel slot that
+   covers its wake-up tick, relative to sleep_wheel_tick. */
+static void
+sleep_wheel_insert (struct thread *th)
+{
+  int64_t wakeup = th->wakeup_at_tick;
+  int64_t delta;
+
+  if (wakeup < sleep_wheel_tick)
+    wakeup = sleep_wheel_tick;
+  delta = wakeup - sleep_wheel_tick;
+
+  if (delta < SLEEP_WHEEL0_SIZE)
+    list_push_back (&sleep_wheel0[wakeup % SLEEP_WHEEL0_SIZE], &th->sleepelem);
+  else if (delta < SLEEP_WHEEL0_SIZE * SLEEP_WHEEL1_SIZE)
+    list_push_back (&sleep_wheel1[(wakeup >> SLEEP_WHEEL0_BITS)
+                                  % SLEEP_WHEEL1_SIZE], &th->sleepelem);
+  else
+    list_push_back (&sleep_overflow, &th->sleepelem);
+}
+
+/* Re-files every thread on SLOT, which now falls within a
+   closer range of the timer wheel. */
+static void
+sleep_wheel_cascade (struct list *slot)
+{
+  struct list pending;
+
+  list_init (&pending);
+  while (!list_empty (slot))
+    list_push_back (&pending, list_pop_front (slot));
+  while (!list_empty (&pending))
+    sleep_wheel_insert (list_entry (list_pop_front (&pending),
+                                    struct thread, sleepelem));
+}
+
+/* Wakes up the sleeping threads whose wake-up tick has been
+   reached, advancing the timer wheel up to the current tick.
+   Only the slot of each elapsed tick is examined. */
 void
 check_sleeping_threads (void)
 {
   enum intr_level old_lvl = intr_disable ();
 
-  struct list_elem * it = list_begin (&sleeping_list);
-
   int64_t now = timer_ticks ();
-  while (it != list_end (&sleeping_list))
+  if (sleeping_threads == 0)
+    sleep_wheel_tick = now + 1;
+
+  while (sleep_wheel_tick <= now)
   {
-    struct list_elem * next = list_next (it);
-    struct thread * th = list_entry (it, struct thread, elem);
+    int slot = sleep_wheel_tick % SLEEP_WHEEL0_SIZE;
+    struct list * due = &sleep_wheel0[slot];
+
+    /* Entering a new level-0 span: pull its threads down from
+       level 1, and from the overflow list when level 1 wraps. */
+    if (slot == 0)
+    {
+      int slot1 = (sleep_wheel_tick >> SLEEP_WHEEL0_BITS) % SLEEP_WHEEL1_SIZE;
+      sleep_wheel_cascade (&sleep_wheel1[slot1]);
+      if (slot1 == 0)
+        sleep_wheel_cascade (&sleep_overflow);
+    }
 
-    if (now >= th->wakeup_at_tick)
+    while (!list_empty (due))
     {
-      list_remove (it);
+      struct thread * th = list_entry (list_pop_front (due),
+                                       struct thread, sleepelem);
+      sleeping_threads--;
+      if (th->timed_wait)
+      {
+        /* Deadline of thread_block_until() hit first: take the
+           thread off the wait list it is blocked on. */
+        list_remove (&th->elem);
+        th->timed_wait = false;
+        th->timed_out = true;
+      }
       thread_unblock (th);
-      //printf ("--- woke up thread %p\n", th);
+      if (th->priority > thread_current ()->priority)
+        intr_yield_on_return ();
     }
-    it = next;
+    sleep_wheel_tick++;
   }
   intr_set_level (old_lvl);
 }
 
-
-
-
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
@@ -235,14 +369,18 @@ thread_tick (void)
 
   if (thread_mlfqs) {
     if (t != idle_thread) FPR_INC(&t->recent_cpu);
-    if (timer_ticks() % 4 == 0)
-    {
-      thread_recalculate_priority_all_threads();
-    }
     if (timer_ticks() % TIMER_FREQ == 0)
     {
       thread_recalculate_load_avg();
-      thread_recalculate_recent_cpu_all_threads();
+      thread_decay_recent_cpu();
+    }
+    /* Only the running thread's recent_cpu changed since the
+       last recalculation, so only its priority can differ. */
+    if (timer_ticks() % 4 == 0 && t != idle_thread)
+    {
+      thread_recalculate_priority(t, NULL);
+      if (t->priority < ready_queue_max_priority ())
+        intr_yield_on_return ();
     }
   }
 
@@ -298,6 +436,10 @@ thread_create (const char *name, int priority,
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+#ifdef FILESYS
+  if (thread_current ()->cwd != NULL)
+    t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack'
@@ -364,11 +506,19 @@ thread_create (const char *name, int priority,
 void
 thread_block (void)
 {
+  struct thread *cur = thread_current ();
+  struct lockstat_stamp stamp;
+  bool profile = lockstat_enabled && cur != idle_thread;
+
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  if (profile)
+    lockstat_begin (&stamp);
+  cur->status = THREAD_BLOCKED;
   schedule ();
+  if (profile)
+    lockstat_end (LOCKSTAT_THREAD, NULL, cur->name, &stamp);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -388,8 +538,20 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (t->timed_wait)
+  {
+    /* Woken before the deadline of thread_block_until(). */
+    list_remove (&t->sleepelem);
+    sleeping_threads--;
+    t->timed_wait = false;
+  }
+  if (thread_mlfqs && t != idle_thread)
+  {
+    thread_recalculate_recent_cpu (t, NULL);
+    thread_recalculate_priority (t, NULL);
+  }
   t->status = THREAD_READY;
+  ready_queue_push (t);
 
   intr_set_level (old_level);
 }
@@ -437,6 +599,10 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+#ifdef FILESYS
+  dir_close (thread_current ()->cwd);
+#endif
+  malloc_thread_exit ();
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
@@ -458,25 +624,26 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread)
-    list_push_back(&ready_list, &cur->elem);
   cur->status = THREAD_READY;
+  if (cur != idle_thread)
+    ready_queue_push (cur);
   schedule ();
   intr_set_level (old_level);
 }
 
 /* Checks if the currently running thread has the highest priority.
-   If not, yield (the scheduler picks up the highest priority thread). */
+   If not, yield (the scheduler picks up the highest priority thread).
+   Within an interrupt handler, the yield is deferred until the
+   handler returns. */
 void
 thread_yield_for_higher_priority (void) {
   enum intr_level old_level = intr_disable();
 
-  if (!list_empty(&ready_list))
+  if (thread_current ()->priority < ready_queue_max_priority ())
   {
-    struct list_elem * max    = list_max (&ready_list, thread_cmp_priority, NULL);
-    struct thread    * th_max = list_entry (max, struct thread, elem);
-    struct thread    * th_cur = thread_current ();
-    if (th_cur->priority < th_max->priority)
+    if (intr_context ())
+      intr_yield_on_return ();
+    else
       thread_yield();
   }
 
@@ -500,14 +667,65 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  Priority
+   donated to the thread keeps its effective priority up until the
+   donors are gone. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+
+  cur->base_priority = new_priority;
+  if (thread_mlfqs)
+    thread_change_priority (cur, new_priority);
+  else
+    thread_refresh_priority (cur);
+
+  intr_set_level (old_level);
   thread_yield_for_higher_priority ();
 }
 
+/* Raises T's effective priority to PRIORITY on behalf of a
+   thread waiting for a lock that T holds.  Never lowers it.
+   Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority < priority)
+    thread_change_priority (t, priority);
+}
+
+/* Recomputes T's effective priority as the highest of its base
+   priority and the priorities of the threads still waiting for
+   the locks that T holds.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock, elem)->semaphore.waiters;
+      if (!list_empty (waiters))
+        {
+          struct thread *donor = list_entry (list_max (waiters,
+                                                       thread_cmp_priority,
+                                                       NULL),
+                                             struct thread, elem);
+          if (donor->priority > priority)
+            priority = donor->priority;
+        }
+    }
+  thread_change_priority (t, priority);
+}
+
 /* Returns the current thread's priority. */
 int
 thread_get_priority (void)
@@ -515,41 +733,101 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Recalculate the thread's recent_cpu based on niceness. */
+/* Recalculate the thread's recent_cpu based on niceness, applying
+   every once-per-second decay it has not seen yet.  The decays
+   from mark M to now multiply recent_cpu by the product P of
+   their coefficients and add nice * (sum_now - P * sum_M), so
+   they take constant time however many were missed. */
 void
 thread_recalculate_recent_cpu (struct thread * th, void * aux UNUSED)
 {
-  FPReal part1 = FPR_MUL_INT(load_avg , 2    ); // 2*load_avg
-  FPReal part2 = FPR_ADD_INT(part1    , 1    ); // 2*load_avg + 1
-  FPReal part3 = FPR_DIV_FPR(part1    , part2); // (2*load_avg)/(2*load_avg + 1)
-  th->recent_cpu = FPR_MUL_FPR(part3, th->recent_cpu);    // (...) * recent_cpu
-  th->recent_cpu = FPR_ADD_INT(th->recent_cpu, th->nice); // (...) + nice
+  const struct decay_mark *m = &th->recent_cpu_mark;
+  unsigned shift = decay_now.shift - m->shift;
+  FPReal product = 0;
+
+  if (m->epoch == decay_now.epoch)
+    return;
+  if (m->gen == decay_now.gen && shift < 32)
+    product = ((((uint64_t) decay_now.scale << FRACBITS) / m->scale)
+               >> shift);
+  th->recent_cpu = FPR_SUB_FPR(th->recent_cpu, FPR_MUL_INT(m->sum, th->nice));
+  th->recent_cpu = FPR_MUL_FPR(product, th->recent_cpu);
+  th->recent_cpu = FPR_ADD_FPR(th->recent_cpu,
+                               FPR_MUL_INT(decay_now.sum, th->nice));
+  th->recent_cpu_mark = decay_now;
 }
 
-/* Recalculate recent_cpu for ALL threads. */
-void
-thread_recalculate_recent_cpu_all_threads ()
+/* Performs the once-per-second recent_cpu decay.  The running
+   thread and the ready threads are updated (and requeued if their
+   priority level changes) right away, because the scheduler picks
+   among the ready threads by priority; blocked threads catch up
+   lazily in thread_unblock().  The cost is thus proportional to
+   the number of ready threads, not to the total number. */
+static void
+thread_decay_recent_cpu (void)
 {
-  enum intr_level old_level = intr_disable();
-  thread_foreach(thread_recalculate_recent_cpu, NULL);
-  intr_set_level(old_level);
+  struct thread *cur = thread_current ();
+  int pri;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  FPReal part1 = FPR_MUL_INT(load_avg , 2    ); // 2*load_avg
+  FPReal part2 = FPR_ADD_INT(part1    , 1    ); // 2*load_avg + 1
+  FPReal coeff = FPR_DIV_FPR(part1, part2);
+  decay_now.epoch++;
+  decay_now.sum = FPR_ADD_INT(FPR_MUL_FPR(coeff, decay_now.sum), 1);
+  if (coeff == 0)
+  {
+    /* Every recent_cpu becomes nice: start a new product. */
+    decay_now.gen++;
+    decay_now.scale = 1u << 30;
+    decay_now.shift = 0;
+  }
+  else
+  {
+    decay_now.scale = ((uint64_t) decay_now.scale * coeff) >> FRACBITS;
+    while (decay_now.scale < (1u << 30))
+    {
+      decay_now.scale <<= 1;
+      decay_now.shift++;
+    }
+  }
+
+  if (cur != idle_thread)
+  {
+    thread_recalculate_recent_cpu (cur, NULL);
+    thread_recalculate_priority (cur, NULL);
+  }
+
+  /* A requeued thread may land in a queue not visited yet; its
+     epoch is then current, so it is not decayed twice. */
+  for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+  {
+    struct list_elem * it = list_begin (&ready_queues[pri]);
+    while (it != list_end (&ready_queues[pri]))
+    {
+      struct list_elem * next = list_next (it);
+      struct thread * th = list_entry (it, struct thread, elem);
+      if (th->recent_cpu_mark.epoch != decay_now.epoch)
+      {
+        thread_recalculate_recent_cpu (th, NULL);
+        thread_recalculate_priority (th, NULL);
+      }
+      it = next;
+    }
+  }
 }
 
 /* Recalculate the thread's priority based on the niceness value. */
 void
 thread_recalculate_priority (struct thread * th, void * aux UNUSED)
 {
-  th->priority = PRI_MAX - FPR_TO_INT(FPR_DIV_INT(th->recent_cpu, 4)) - (th->nice * 2);
-}
-
-/* Recalculate the threads' priorities based on their niceness
-   values, for all threads in the system. */
-void
-thread_recalculate_priority_all_threads ()
-{
-  enum intr_level old_level = intr_disable();
-  thread_foreach(thread_recalculate_priority, NULL);
-  intr_set_level(old_level);
+  int priority = PRI_MAX - FPR_TO_INT(FPR_DIV_INT(th->recent_cpu, 4)) - (th->nice * 2);
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  thread_change_priority (th, priority);
 }
 
 /* Sets the current thread's nice value to NICE and yields, in
@@ -560,17 +838,7 @@ thread_set_nice (int new_nice)
 {
   thread_current ()->nice = new_nice;
   thread_recalculate_priority (thread_current (), NULL);
-  int new_priority = thread_current ()->priority;
-
-  enum intr_level old_lvl = intr_disable();
-
-  struct list_elem * elem_ready_thread_max = list_max(&ready_list, thread_cmp_priority, NULL);
-  struct thread    * ready_thread_max  = list_entry(elem_ready_thread_max, struct thread, elem);
-
-  intr_set_level (old_lvl);
-
-  if (new_priority < ready_thread_max->priority)
-     thread_yield();
+  thread_yield_for_higher_priority ();
 }
 
 /* Returns the current thread's nice value. */
@@ -588,10 +856,10 @@ thread_recalculate_load_avg() {
   FPReal parcel_2;
   if (thread_current() != idle_thread)
     //ready_threads + 1 (current thread)
-    parcel_2 = INT_DIV_INT (list_size (&ready_list) + 1, 60);
+    parcel_2 = INT_DIV_INT (ready_threads + 1, 60);
   else
     //ready_threads     (current thread)
-    parcel_2 = INT_DIV_INT (list_size (&ready_list)    , 60);
+    parcel_2 = INT_DIV_INT (ready_threads    , 60);
   load_avg = FPR_ADD_FPR (parcel_1, parcel_2);
 }
 
@@ -709,6 +977,9 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
 
   t->priority = priority;
+  t->base_priority = priority;
+  t->waiting_on_lock = NULL;
+  list_init (&t->held_locks);
 
   sema_init(&(t->exec_sema), 0);
   // TODO
@@ -721,6 +992,7 @@ init_thread (struct thread *t, const char *name, int priority)
   {
     t->nice       = NICE_DEFAULT;
     t->recent_cpu = 0;
+    t->recent_cpu_mark = decay_now;
     thread_recalculate_priority(t, NULL);
   }
 
@@ -750,17 +1022,76 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  if (ready_threads == 0)
     return idle_thread;
   else
   {
-    struct list_elem * el_th_max = list_max   (&ready_list, thread_cmp_priority, NULL);
+    int max_priority = ready_queue_max_priority ();
+    struct list_elem * el_th_max = list_front (&ready_queues[max_priority]);
     struct thread    * th_max    = list_entry (el_th_max, struct thread, elem);
-    list_remove (el_th_max);
+    ready_queue_remove (th_max);
     return th_max;
   }
 }
 
+/* Appends T to the run queue of its priority level.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap[t->priority / 32] |= 1u << (t->priority % 32);
+  ready_threads++;
+}
+
+/* Removes T from the run queue of its priority level.
+   Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap[t->priority / 32] &= ~(1u << (t->priority % 32));
+  ready_threads--;
+}
+
+/* Returns the highest priority among the ready threads, or
+   PRI_NONE if there is none. */
+static int
+ready_queue_max_priority (void)
+{
+  int word;
+
+  for (word = READY_BITMAP_WORDS - 1; word >= 0; word--)
+    if (ready_bitmap[word] != 0)
+      return word * 32 + 31 - __builtin_clz (ready_bitmap[word]);
+  return PRI_NONE;
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready. */
+static void
+thread_change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t->status == THREAD_READY && t->priority != priority)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+
+  intr_set_level (old_level);
+}
+
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
 
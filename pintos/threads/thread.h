@@ -5,8 +5,31 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/fpr_arith.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
+struct dir;
+struct file;
+
+/* Number of file descriptors a process can have, including the
+   console's 0 and 1. */
+#define FD_CNT 32
+
+/* A point in the sequence of once-per-second recent_cpu decays,
+   each of which sets recent_cpu to C * recent_cpu + nice for the
+   coefficient C of that second.  The product of the C since the
+   last C of 0 is SCALE * 2**-(30 + SHIFT), with SCALE kept in
+   [2**30, 2**31) so that it never underflows. */
+struct decay_mark
+  {
+    unsigned epoch;             /* Number of decays so far. */
+    unsigned gen;               /* Number of decays with C == 0. */
+    uint32_t scale;             /* Mantissa of the product. */
+    unsigned shift;             /* Exponent of the product. */
+    FPReal sum;                 /* recent_cpu of an idle thread with
+                                   nice 1 that had 0 at epoch 0. */
+  };
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -103,25 +126,50 @@ struct thread
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. Used either for ready_list or sleeping_list. */
+    struct list_elem elem;              /* List element. Used either for a run queue or a wait list. */
 
-		struct list_elem test;              /* List element. Used either for ready_list or sleeping_list. */
+		struct list_elem test;              /* List element. Used either for a run queue or the sleep wheel. */
 
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t * pagedir;                 /* Page directory. */
+
+    /* Owned by userprog/syscall.c.  Each file descriptor refers to
+       an open file or, if it was opened on a directory, to an
+       open directory. */
+    struct file *files[FD_CNT];         /* Open files. */
+    struct dir *dirs[FD_CNT];           /* Open directories. */
 #endif
 
-    int64_t wakeup_at_tick;
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, or null for root. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal operations. */
+#endif
+
+    /* Owned by thread.c, for thread_sleep() and thread_block_until(). */
+    struct list_elem sleepelem;         /* List element for the sleep wheel. */
+    int64_t wakeup_at_tick;             /* Tick to wake up at. */
+    bool timed_wait;                    /* In thread_block_until()? */
+    bool timed_out;                     /* Woken up by the deadline? */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
     /* Advance scheduling data */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donations. */
+    struct lock *waiting_on_lock;       /* Lock being acquired, if any. */
+    struct list held_locks;             /* Locks held, for donation. */
     int nice;                           /* Niceness value. */
     FPReal recent_cpu;                  /* Recent cpu usage of the thread. */
+    struct decay_mark recent_cpu_mark;  /* Last decay applied. */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine magazines[MALLOC_CLASS_CNT]; /* Free block caches. */
 
     /* Used for userprof/process_wait */
     tid_t parentId;
@@ -154,6 +202,7 @@ typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *, tid_t parent);
 
 void thread_block (void);
+bool thread_block_until (int64_t deadline);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
@@ -162,7 +211,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
-void thread_yield_on_higher_priority (void);
+void thread_yield_for_higher_priority (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -170,6 +219,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -178,7 +229,7 @@ int thread_get_load_avg (void);
 
 void thread_sleep (int64_t wakeup_at);
 
-bool thread_priority_cmp (const struct list_elem* a,
+bool thread_cmp_priority (const struct list_elem* a,
   const struct list_elem* b,
   void* aux);
 
@@ -1,6 +1,11 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -12,6 +17,22 @@ void exit (int status);
 pid_t exec (const char *cmd_line);
 int wait (pid_t pid);
 
+static void check_user (const void *uaddr, size_t size);
+static void check_string (const char *);
+static bool sys_create (const char *, unsigned initial_size);
+static bool sys_remove (const char *);
+static int sys_open (const char *);
+static int sys_filesize (int fd);
+static int sys_read (int fd, void *, unsigned size);
+static int sys_write (int fd, const void *, unsigned size);
+static void sys_seek (int fd, unsigned position);
+static unsigned sys_tell (int fd);
+static void sys_close (int fd);
+static bool sys_chdir (const char *);
+static bool sys_mkdir (const char *);
+static bool sys_readdir (int fd, char name[READDIR_MAX_LEN + 1]);
+static bool sys_isdir (int fd);
+static int sys_inumber (int fd);
 
 void
 syscall_init (void)
@@ -33,6 +54,12 @@ syscall_handler (struct intr_frame *f UNUSED)
           // printf("\nprintf: %s\nputbuf: ", *(esp+2));
           putbuf(*(esp+2), *(esp+3));
         }
+        else
+          {
+            check_user (esp + 1, 3 * sizeof *esp);
+            check_user ((void *) esp[2], esp[3]);
+            f->eax = sys_write (esp[1], (void *) esp[2], esp[3]);
+          }
   			break;
   		}
   	case SYS_EXIT: //first to do
@@ -58,11 +85,284 @@ syscall_handler (struct intr_frame *f UNUSED)
 				}
         break;
       }
+    case SYS_CREATE:
+      check_user (esp + 1, 2 * sizeof *esp);
+      check_string ((char *) esp[1]);
+      f->eax = sys_create ((char *) esp[1], esp[2]);
+      break;
+    case SYS_REMOVE:
+      check_user (esp + 1, sizeof *esp);
+      check_string ((char *) esp[1]);
+      f->eax = sys_remove ((char *) esp[1]);
+      break;
+    case SYS_OPEN:
+      check_user (esp + 1, sizeof *esp);
+      check_string ((char *) esp[1]);
+      f->eax = sys_open ((char *) esp[1]);
+      break;
+    case SYS_FILESIZE:
+      check_user (esp + 1, sizeof *esp);
+      f->eax = sys_filesize (esp[1]);
+      break;
+    case SYS_READ:
+      check_user (esp + 1, 3 * sizeof *esp);
+      check_user ((void *) esp[2], esp[3]);
+      f->eax = sys_read (esp[1], (void *) esp[2], esp[3]);
+      break;
+    case SYS_SEEK:
+      check_user (esp + 1, 2 * sizeof *esp);
+      sys_seek (esp[1], esp[2]);
+      break;
+    case SYS_TELL:
+      check_user (esp + 1, sizeof *esp);
+      f->eax = sys_tell (esp[1]);
+      break;
+    case SYS_CLOSE:
+      check_user (esp + 1, sizeof *esp);
+      sys_close (esp[1]);
+      break;
+    case SYS_CHDIR:
+      check_user (esp + 1, sizeof *esp);
+      check_string ((char *) esp[1]);
+      f->eax = sys_chdir ((char *) esp[1]);
+      break;
+    case SYS_MKDIR:
+      check_user (esp + 1, sizeof *esp);
+      check_string ((char *) esp[1]);
+      f->eax = sys_mkdir ((char *) esp[1]);
+      break;
+    case SYS_READDIR:
+      check_user (esp + 1, 2 * sizeof *esp);
+      check_user ((void *) esp[2], READDIR_MAX_LEN + 1);
+      f->eax = sys_readdir (esp[1], (char *) esp[2]);
+      break;
+    case SYS_ISDIR:
+      check_user (esp + 1, sizeof *esp);
+      f->eax = sys_isdir (esp[1]);
+      break;
+    case SYS_INUMBER:
+      check_user (esp + 1, sizeof *esp);
+      f->eax = sys_inumber (esp[1]);
+      break;
   	default:
   		break;
   }
 }
 
+/* Terminates the process if any of the SIZE bytes starting at
+   UADDR is not mapped user memory. */
+static void
+check_user (const void *uaddr, size_t size)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0)
+    return;
+  if (end < p || !is_user_vaddr (end - 1))
+    exit (-1);
+  for (p = pg_round_down (p); p < end; p += PGSIZE)
+    if (!is_user_vaddr (p)
+        || pagedir_get_page (thread_current ()->pagedir, p) == NULL)
+      exit (-1);
+}
+
+/* Terminates the process if string S does not lie entirely in
+   mapped user memory. */
+static void
+check_string (const char *s)
+{
+  for (;;)
+    {
+      check_user (s, 1);
+      if (*s++ == '\0')
+        return;
+    }
+}
+
+/* File descriptors. */
+
+/* Returns the open file for FD in the running process, or a null
+   pointer if FD is not open. */
+static struct file *
+fd_file (int fd)
+{
+  return fd >= 2 && fd < FD_CNT ? thread_current ()->files[fd] : NULL;
+}
+
+/* Returns the open directory for FD in the running process, or a
+   null pointer if FD is not open on a directory. */
+static struct dir *
+fd_dir (int fd)
+{
+  return fd_file (fd) != NULL ? thread_current ()->dirs[fd] : NULL;
+}
+
+static bool
+sys_create (const char *name, unsigned initial_size)
+{
+  return filesys_create (name, initial_size);
+}
+
+static bool
+sys_remove (const char *name)
+{
+  return filesys_remove (name);
+}
+
+/* Opens NAME, which may be a file or a directory, and returns a
+   new file descriptor for it, or -1 on failure. */
+static int
+sys_open (const char *name)
+{
+  struct thread *t = thread_current ();
+  struct file *file;
+  struct dir *dir = NULL;
+  int fd;
+
+  for (fd = 2; fd < FD_CNT; fd++)
+    if (t->files[fd] == NULL)
+      break;
+  if (fd >= FD_CNT)
+    return -1;
+
+  file = filesys_open (name);
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    {
+      dir = dir_open (inode_reopen (file_get_inode (file)));
+      if (dir == NULL)
+        {
+          file_close (file);
+          file = NULL;
+        }
+    }
+
+  if (file == NULL)
+    return -1;
+  t->files[fd] = file;
+  t->dirs[fd] = dir;
+  return fd;
+}
+
+static int
+sys_filesize (int fd)
+{
+  struct file *file = fd_file (fd);
+
+  if (file == NULL)
+    return -1;
+  return file_length (file);
+}
+
+static int
+sys_read (int fd, void *buffer, unsigned size)
+{
+  struct file *file = fd_file (fd);
+
+  if (fd == 0)
+    {
+      uint8_t *p = buffer;
+      unsigned i;
+
+      for (i = 0; i < size; i++)
+        p[i] = input_getc ();
+      return size;
+    }
+  if (file == NULL || fd_dir (fd) != NULL)
+    return -1;
+  return file_read (file, buffer, size);
+}
+
+static int
+sys_write (int fd, const void *buffer, unsigned size)
+{
+  struct file *file = fd_file (fd);
+
+  if (file == NULL || fd_dir (fd) != NULL)
+    return -1;
+  return file_write (file, buffer, size);
+}
+
+static void
+sys_seek (int fd, unsigned position)
+{
+  struct file *file = fd_file (fd);
+
+  if (file == NULL)
+    return;
+  file_seek (file, position);
+}
+
+static unsigned
+sys_tell (int fd)
+{
+  struct file *file = fd_file (fd);
+
+  if (file == NULL)
+    return 0;
+  return file_tell (file);
+}
+
+static void
+sys_close (int fd)
+{
+  struct thread *t = thread_current ();
+  struct file *file = fd_file (fd);
+
+  if (file == NULL)
+    return;
+  dir_close (t->dirs[fd]);
+  file_close (file);
+  t->files[fd] = NULL;
+  t->dirs[fd] = NULL;
+}
+
+/* Closes all of the running process's file descriptors. */
+void
+syscall_close_all (void)
+{
+  int fd;
+
+  for (fd = 2; fd < FD_CNT; fd++)
+    sys_close (fd);
+}
+
+static bool
+sys_chdir (const char *name)
+{
+  return filesys_chdir (name);
+}
+
+static bool
+sys_mkdir (const char *name)
+{
+  return filesys_mkdir (name);
+}
+
+static bool
+sys_readdir (int fd, char name[READDIR_MAX_LEN + 1])
+{
+  struct dir *dir = fd_dir (fd);
+
+  if (dir == NULL)
+    return false;
+  return dir_readdir (dir, name);
+}
+
+static bool
+sys_isdir (int fd)
+{
+  return fd_dir (fd) != NULL;
+}
+
+static int
+sys_inumber (int fd)
+{
+  struct file *file = fd_file (fd);
+
+  return file != NULL ? (int) inode_get_inumber (file_get_inode (file)) : -1;
+}
+
 // void bad_ptr (const void *ptr)
 // {
 //   if (is_user_vaddr(ptr) &&  pagedir_get_page(thread_current()->pagedir, ptr))